@@ -0,0 +1,665 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sched.h>
+
+/* Allocator microbenchmarks.
+ * Build: make bench_lmm
+ * Add -DMM_COMPACT_HEADERS to CFLAGS to measure the 8-byte block header
+ * layout. Comparisons against glibc malloc live in bench_suite.c. */
+
+#define BENCH_FREE_BLOCKS 100000
+#define BENCH_TRACE_SLOTS 2000
+#define BENCH_TRACE_OPS   200000
+#define BENCH_SLAB_OBJECTS 100000
+#define BENCH_MT_MAX_THREADS 8
+#define BENCH_MT_ROUNDS 20000
+#define BENCH_MT_BATCH 16
+#define BENCH_LOOKUP_FAMILIES 300
+#define BENCH_LOOKUP_OPS 200000
+#define BENCH_PINGPONG_OPS 200000
+#define BENCH_TOUCH_REFILL 256
+#define BENCH_TOUCH_OBJECTS 20000
+#define BENCH_TOUCH_SIZE 1024
+#define BENCH_BULK_BATCH 64
+#define BENCH_BULK_ROUNDS 20000
+#define BENCH_ARENA_OBJECTS 2000
+#define BENCH_ARENA_ROUNDS 500
+#define BENCH_REALLOC_BUFFERS 64
+#define BENCH_REALLOC_ROUNDS 2000
+#define BENCH_REMOTE_PAIRS 2
+#define BENCH_REMOTE_OBJECTS 400000 /* per producer */
+#define BENCH_REMOTE_RING 1024
+#define BENCH_DENSITY_OBJECTS 50000
+#define BENCH_STATS_POLLS 100000
+#define BENCH_STATS_THREADS 4
+#define BENCH_PROFILE_SLOTS 4096
+#define BENCH_PROFILE_OPS 2000000
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/* Free 100k blocks: every other block first, so the free heap fills with
+ * isolated fragments, then the rest, so each free merges two heap entries.
+ * With heap_index removal both phases should stay flat per operation. */
+static void bench_free_100k(void) {
+    static void *ptrs[BENCH_FREE_BLOCKS];
+
+    MM_REG_STRUCT(bench_free, 32);
+    mm_set_page_family_refill("bench_free", 64);
+    vm_page_family_t *family = lookup_page_family_by_name("bench_free");
+
+    for (int i = 0; i < BENCH_FREE_BLOCKS; i++) {
+        ptrs[i] = xcalloc("bench_free", 32);
+        if (!ptrs[i]) {
+            printf("bench_free_100k: allocation %d failed\n", i);
+            return;
+        }
+    }
+
+    double t0 = now_ns();
+    for (int i = 0; i < BENCH_FREE_BLOCKS; i += 2)
+        xfree(ptrs[i]);
+    double t1 = now_ns();
+    uint32_t fragments = family->heap_size;
+    for (int i = 1; i < BENCH_FREE_BLOCKS; i += 2)
+        xfree(ptrs[i]);
+    double t2 = now_ns();
+
+    printf("free_100k: %u free fragments at midpoint\n", fragments);
+    printf("  phase 1 (isolated frees): %8.1f ns/free\n", (t1 - t0) / (BENCH_FREE_BLOCKS / 2));
+    printf("  phase 2 (merging frees):  %8.1f ns/free\n", (t2 - t1) / (BENCH_FREE_BLOCKS / 2));
+    printf("  heap entries left: %u\n", family->heap_size);
+}
+
+static uint32_t bench_rand(uint32_t *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static uint32_t family_page_count(vm_page_family_t *family) {
+    uint32_t pages = 0;
+    for (vm_page_t *page = family->first_page; page; page = page->next)
+        pages++;
+    return pages;
+}
+
+/* Replay the same random mixed-size alloc/free trace under one policy and
+ * report throughput plus how much of the mapped memory is actually live. */
+static void bench_policy_trace(const char *name, mm_alloc_policy_t policy) {
+    static void *slots[BENCH_TRACE_SLOTS];
+    static uint32_t sizes[BENCH_TRACE_SLOTS];
+    uint32_t seed = 12345, peak_pages = 0;
+    uint64_t live_bytes = 0;
+
+    mm_instantiate_new_page_family(name, 512);
+    mm_set_page_family_policy(name, policy);
+    vm_page_family_t *family = lookup_page_family_by_name(name);
+    memset(slots, 0, sizeof(slots));
+
+    double t0 = now_ns();
+    for (int op = 0; op < BENCH_TRACE_OPS; op++) {
+        uint32_t slot = bench_rand(&seed) % BENCH_TRACE_SLOTS;
+        if (slots[slot]) {
+            xfree(slots[slot]);
+            slots[slot] = NULL;
+            live_bytes -= sizes[slot];
+        } else {
+            sizes[slot] = 16 + bench_rand(&seed) % 497;
+            slots[slot] = xcalloc(name, sizes[slot]);
+            live_bytes += sizes[slot];
+        }
+        if ((op & 1023) == 0) {
+            uint32_t pages = family_page_count(family);
+            if (pages > peak_pages) peak_pages = pages;
+        }
+    }
+    double t1 = now_ns();
+
+    uint32_t pages = family_page_count(family);
+    double mapped = (double)pages * SYSTEM_PAGE_SIZE;
+    printf("  %-10s %8.1f ns/op  pages: %u (peak %u)  live/mapped: %5.1f%%\n",
+           policy == MM_POLICY_DENSE ? "dense" :
+           policy == MM_POLICY_SIZE_CLASS ? "size-class" : "max-heap",
+           (t1 - t0) / BENCH_TRACE_OPS, pages, peak_pages,
+           mapped ? 100.0 * (double)live_bytes / mapped : 0.0);
+
+    for (int i = 0; i < BENCH_TRACE_SLOTS; i++)
+        if (slots[i]) xfree(slots[i]);
+}
+
+/* Allocate and free 100k single structs through the block path and through
+ * a slab family, reporting latency and mapped bytes per live object. */
+static void bench_slab_vs_blocks(const char *name, int slab) {
+    static void *objs[BENCH_SLAB_OBJECTS];
+
+    if (slab) {
+        MM_REG_STRUCT_SLAB(bench_slab, 32);
+    } else {
+        MM_REG_STRUCT(bench_block, 32);
+    }
+    vm_page_family_t *family = lookup_page_family_by_name(name);
+
+    double t0 = now_ns();
+    for (int i = 0; i < BENCH_SLAB_OBJECTS; i++)
+        objs[i] = xcalloc(name, 32);
+    double t1 = now_ns();
+
+    uint32_t pages = family_page_count(family);
+    for (mm_slab_t *s = family->full_slabs; s; s = s->next) pages++;
+    for (mm_slab_t *s = family->partial_slabs; s; s = s->next) pages++;
+
+    for (int i = 0; i < BENCH_SLAB_OBJECTS; i++)
+        xfree(objs[i]);
+    double t2 = now_ns();
+
+    printf("  %-6s alloc %6.1f ns  free %6.1f ns  %5.1f mapped bytes/object\n",
+           slab ? "slab" : "blocks",
+           (t1 - t0) / BENCH_SLAB_OBJECTS, (t2 - t1) / BENCH_SLAB_OBJECTS,
+           (double)pages * SYSTEM_PAGE_SIZE / BENCH_SLAB_OBJECTS);
+}
+
+/* Each thread repeatedly allocates a small batch and frees it again */
+static void *bench_mt_worker(void *arg) {
+    (void)arg;
+    void *batch[BENCH_MT_BATCH];
+    for (int r = 0; r < BENCH_MT_ROUNDS; r++) {
+        for (int i = 0; i < BENCH_MT_BATCH; i++)
+            batch[i] = xcalloc("bench_mt", 64);
+        for (int i = 0; i < BENCH_MT_BATCH; i++)
+            xfree(batch[i]);
+    }
+    return NULL;
+}
+
+static void bench_mt_scaling(bool thread_cache) {
+    pthread_t threads[BENCH_MT_MAX_THREADS];
+
+    mm_set_thread_cache(thread_cache);
+    printf("  thread cache %s:\n", thread_cache ? "on" : "off");
+    for (int n = 1; n <= BENCH_MT_MAX_THREADS; n *= 2) {
+        double t0 = now_ns();
+        for (int i = 0; i < n; i++)
+            pthread_create(&threads[i], NULL, bench_mt_worker, NULL);
+        for (int i = 0; i < n; i++)
+            pthread_join(threads[i], NULL);
+        double t1 = now_ns();
+
+        double ops = 2.0 * n * BENCH_MT_ROUNDS * BENCH_MT_BATCH;
+        printf("    %d thread(s): %8.2f Mops/s\n", n, ops / (t1 - t0) * 1e3);
+    }
+    mm_set_thread_cache(false);
+}
+
+/* Allocation latency by name versus by handle with many families registered */
+static void bench_lookup_vs_handle(void) {
+    char name[MM_MAX_STRUCT_NAME];
+    for (int i = 0; i < BENCH_LOOKUP_FAMILIES; i++) {
+        snprintf(name, sizeof(name), "bench_lookup_%d", i);
+        mm_instantiate_new_page_family(name, 48);
+    }
+    mm_family_handle_t handle = lookup_page_family_by_name(name);
+    void *keeper = xcalloc_h(handle, 48); /* keep the page mapped */
+
+    double t0 = now_ns();
+    for (int i = 0; i < BENCH_LOOKUP_OPS; i++)
+        xfree(xcalloc(name, 48));
+    double t1 = now_ns();
+    for (int i = 0; i < BENCH_LOOKUP_OPS; i++)
+        xfree(xcalloc_h(handle, 48));
+    double t2 = now_ns();
+
+    printf("  by name:   %6.1f ns per alloc+free\n", (t1 - t0) / BENCH_LOOKUP_OPS);
+    printf("  by handle: %6.1f ns per alloc+free\n", (t2 - t1) / BENCH_LOOKUP_OPS);
+    xfree(keeper);
+}
+
+/* Allocate and free the only object of a family: every free empties the page */
+static void bench_page_pingpong(const char *name, uint32_t empty_high) {
+    mm_family_handle_t family = mm_instantiate_new_page_family(name, 256);
+    mm_set_page_family_empty_cache(name, 0, empty_high);
+
+    double t0 = now_ns();
+    for (int i = 0; i < BENCH_PINGPONG_OPS; i++)
+        xfree(xcalloc_h(family, 256));
+    double t1 = now_ns();
+
+    printf("  retain %u page(s): %7.1f ns per alloc+free\n",
+           empty_high, (t1 - t0) / BENCH_PINGPONG_OPS);
+}
+
+static long minor_faults(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_minflt;
+}
+
+/* Fill a fresh family, free everything, fill it again from the now dirty
+ * retained pages. mode 0: xcalloc, 1: xmalloc, 2: xmalloc + memset, which is
+ * what every xcalloc used to cost on top of the eager page memset. */
+static void bench_touch_round(const char *name, int mode) {
+    static void *objs[BENCH_TOUCH_OBJECTS];
+    static const char *what[] = { "xcalloc", "xmalloc", "eager memset" };
+    mm_family_handle_t family = mm_instantiate_new_page_family(name, BENCH_TOUCH_SIZE);
+    mm_set_page_family_refill(name, BENCH_TOUCH_REFILL);
+    mm_set_page_family_empty_cache(name, 0, BENCH_TOUCH_OBJECTS);
+
+    long faults = 0;
+    double ns[2];
+    for (int round = 0; round < 2; round++) {
+        long f0 = minor_faults();
+        double t0 = now_ns();
+        for (int i = 0; i < BENCH_TOUCH_OBJECTS; i++) {
+            if (mode == 0) {
+                objs[i] = xcalloc_h(family, BENCH_TOUCH_SIZE);
+            } else {
+                objs[i] = xmalloc_h(family, BENCH_TOUCH_SIZE);
+                if (mode == 2) memset(objs[i], 0, BENCH_TOUCH_SIZE);
+            }
+        }
+        ns[round] = (now_ns() - t0) / BENCH_TOUCH_OBJECTS;
+        if (round == 0) faults = minor_faults() - f0;
+        for (int i = 0; i < BENCH_TOUCH_OBJECTS; i++)
+            xfree(objs[i]);
+    }
+    printf("  %-12s fresh %6.1f ns/object (%5ld faults), recycled %6.1f ns/object\n",
+           what[mode], ns[0], faults, ns[1]);
+}
+
+/* First-touch costs: faults taken by one allocation out of a large refill,
+ * then zeroing strategies on fresh and on recycled memory */
+static void bench_first_touch(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("bench_touch", BENCH_TOUCH_SIZE);
+    mm_set_page_family_refill("bench_touch", BENCH_TOUCH_REFILL);
+
+    long f0 = minor_faults();
+    void *first = xcalloc_h(family, BENCH_TOUCH_SIZE);
+    long f1 = minor_faults();
+    printf("  first object of a %d-page refill: %ld minor fault(s)\n", BENCH_TOUCH_REFILL, f1 - f0);
+    xfree(first);
+
+    bench_touch_round("bench_touch_c", 0);
+    bench_touch_round("bench_touch_m", 1);
+    bench_touch_round("bench_touch_e", 2);
+}
+
+/* Request-handler pattern: dozens of objects allocated and released together */
+static void bench_bulk(void) {
+    void *objs[BENCH_BULK_BATCH];
+    mm_family_handle_t family = mm_instantiate_new_page_family("bench_bulk", 48);
+    void *keeper = xcalloc_h(family, 48);
+
+    double t0 = now_ns();
+    for (int r = 0; r < BENCH_BULK_ROUNDS; r++) {
+        for (int i = 0; i < BENCH_BULK_BATCH; i++)
+            objs[i] = xcalloc_h(family, 48);
+        for (int i = 0; i < BENCH_BULK_BATCH; i++)
+            xfree(objs[i]);
+    }
+    double t1 = now_ns();
+    for (int r = 0; r < BENCH_BULK_ROUNDS; r++) {
+        xcalloc_bulk(family, 48, BENCH_BULK_BATCH, objs);
+        xfree_bulk(objs, BENCH_BULK_BATCH);
+    }
+    double t2 = now_ns();
+
+    double ops = (double)BENCH_BULK_ROUNDS * BENCH_BULK_BATCH;
+    printf("  one at a time: %6.1f ns per object alloc+free\n", (t1 - t0) / ops);
+    printf("  bulk:          %6.1f ns per object alloc+free\n", (t2 - t1) / ops);
+    xfree(keeper);
+}
+
+/* Request-scoped objects of mixed sizes: freed one by one vs an arena reset */
+static void bench_arena(void) {
+    static void *objs[BENCH_ARENA_OBJECTS];
+    mm_family_handle_t family = mm_instantiate_new_page_family("bench_arena", 16);
+    void *keeper = xcalloc_h(family, 16);
+    mm_arena_t *arena = mm_arena_create();
+    uint32_t seed = 42;
+
+    double t0 = now_ns();
+    for (int r = 0; r < BENCH_ARENA_ROUNDS; r++) {
+        for (int i = 0; i < BENCH_ARENA_OBJECTS; i++)
+            objs[i] = xcalloc_h(family, 16 + bench_rand(&seed) % 240);
+        for (int i = 0; i < BENCH_ARENA_OBJECTS; i++)
+            xfree(objs[i]);
+    }
+    double t1 = now_ns();
+    for (int r = 0; r < BENCH_ARENA_ROUNDS; r++) {
+        for (int i = 0; i < BENCH_ARENA_OBJECTS; i++)
+            objs[i] = mm_arena_alloc(arena, 16 + bench_rand(&seed) % 240);
+        mm_arena_reset(arena);
+    }
+    double t2 = now_ns();
+
+    double ops = (double)BENCH_ARENA_ROUNDS * BENCH_ARENA_OBJECTS;
+    printf("  xcalloc + xfree:     %6.1f ns per object\n", (t1 - t0) / ops);
+    printf("  arena alloc + reset: %6.1f ns per object (%u pages held)\n", (t2 - t1) / ops, arena->pages);
+    mm_arena_destroy(arena);
+    xfree(keeper);
+}
+
+/* Buffers grown 64 bytes at a time up to 1 KiB, interleaved so some
+ * neighbours are live: copy on every step vs xrealloc */
+static void bench_realloc(void) {
+    static void *bufs[BENCH_REALLOC_BUFFERS];
+    mm_family_handle_t family = mm_instantiate_new_page_family("bench_realloc", 64);
+    void *keeper = xcalloc_h(family, 64);
+
+    double t0 = now_ns();
+    for (int r = 0; r < BENCH_REALLOC_ROUNDS; r++) {
+        for (int i = 0; i < BENCH_REALLOC_BUFFERS; i++)
+            bufs[i] = xmalloc_h(family, 64);
+        for (uint32_t size = 128; size <= 1024; size += 64) {
+            for (int i = 0; i < BENCH_REALLOC_BUFFERS; i += 1 + (i & 1)) {
+                void *grown = xmalloc_h(family, size);
+                memcpy(grown, bufs[i], size - 64);
+                xfree(bufs[i]);
+                bufs[i] = grown;
+            }
+        }
+        for (int i = 0; i < BENCH_REALLOC_BUFFERS; i++)
+            xfree(bufs[i]);
+    }
+    double t1 = now_ns();
+    mm_stats_t before;
+    mm_get_stats(family, &before);
+    for (int r = 0; r < BENCH_REALLOC_ROUNDS; r++) {
+        for (int i = 0; i < BENCH_REALLOC_BUFFERS; i++)
+            bufs[i] = xmalloc_h(family, 64);
+        for (uint32_t size = 128; size <= 1024; size += 64) {
+            for (int i = 0; i < BENCH_REALLOC_BUFFERS; i += 1 + (i & 1))
+                bufs[i] = xrealloc(bufs[i], size);
+        }
+        for (int i = 0; i < BENCH_REALLOC_BUFFERS; i++)
+            xfree(bufs[i]);
+    }
+    double t2 = now_ns();
+    mm_stats_t after;
+    mm_get_stats(family, &after);
+
+    uint64_t reallocs = after.reallocs - before.reallocs;
+    uint64_t grows = after.realloc_grows_in_place - before.realloc_grows_in_place;
+    printf("  xmalloc + memcpy + xfree: %6.1f ns per step\n", (t1 - t0) / reallocs);
+    printf("  xrealloc:                 %6.1f ns per step (%.1f%% grown in place)\n",
+           (t2 - t1) / reallocs, reallocs ? 100.0 * grows / reallocs : 0.0);
+    xfree(keeper);
+}
+
+/* Cross-thread frees: producers allocate, consumers free what they are
+ * handed through one SPSC ring per pair; every call is timed */
+typedef struct {
+    void *ring[BENCH_REMOTE_RING];
+    uint32_t head;  /* written by the producer */
+    uint32_t tail;  /* written by the consumer */
+    float *alloc_ns;
+    float *free_ns;
+} bench_remote_pair_t;
+
+static mm_family_handle_t bench_remote_family;
+
+static void *bench_remote_producer(void *arg) {
+    bench_remote_pair_t *pair = arg;
+    uint32_t seed = (uint32_t)(uintptr_t)arg;
+    for (uint32_t i = 0; i < BENCH_REMOTE_OBJECTS; i++) {
+        while (i - __atomic_load_n(&pair->tail, __ATOMIC_ACQUIRE) >= BENCH_REMOTE_RING)
+            sched_yield();
+        double t0 = now_ns();
+        void *obj = xmalloc_h(bench_remote_family, 32 + bench_rand(&seed) % 224);
+        pair->alloc_ns[i] = (float)(now_ns() - t0);
+        pair->ring[i % BENCH_REMOTE_RING] = obj;
+        __atomic_store_n(&pair->head, i + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static void *bench_remote_consumer(void *arg) {
+    bench_remote_pair_t *pair = arg;
+    for (uint32_t i = 0; i < BENCH_REMOTE_OBJECTS; i++) {
+        while (__atomic_load_n(&pair->head, __ATOMIC_ACQUIRE) == i)
+            sched_yield();
+        void *obj = pair->ring[i % BENCH_REMOTE_RING];
+        double t0 = now_ns();
+        xfree(obj);
+        pair->free_ns[i] = (float)(now_ns() - t0);
+        __atomic_store_n(&pair->tail, i + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static int bench_float_cmp(const void *a, const void *b) {
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_print_latency(const char *what, float *ns, size_t n) {
+    qsort(ns, n, sizeof(float), bench_float_cmp);
+    printf("    %s p50 %6.0f  p99 %6.0f  p99.9 %7.0f  max %8.0f ns\n", what,
+           ns[n / 2], ns[n * 99 / 100], ns[n * 999 / 1000], ns[n - 1]);
+}
+
+static void bench_remote_free(bool remote) {
+    static bench_remote_pair_t pairs[BENCH_REMOTE_PAIRS];
+    pthread_t threads[2 * BENCH_REMOTE_PAIRS];
+    size_t n = (size_t)BENCH_REMOTE_PAIRS * BENCH_REMOTE_OBJECTS;
+    float *alloc_ns = malloc(n * sizeof(float));
+    float *free_ns = malloc(n * sizeof(float));
+
+    mm_stats_t before, after;
+    mm_get_stats(bench_remote_family, &before);
+    mm_set_remote_free(remote);
+    for (int p = 0; p < BENCH_REMOTE_PAIRS; p++) {
+        pairs[p].head = pairs[p].tail = 0;
+        pairs[p].alloc_ns = alloc_ns + (size_t)p * BENCH_REMOTE_OBJECTS;
+        pairs[p].free_ns = free_ns + (size_t)p * BENCH_REMOTE_OBJECTS;
+    }
+
+    double t0 = now_ns();
+    for (int p = 0; p < BENCH_REMOTE_PAIRS; p++) {
+        pthread_create(&threads[2 * p], NULL, bench_remote_producer, &pairs[p]);
+        pthread_create(&threads[2 * p + 1], NULL, bench_remote_consumer, &pairs[p]);
+    }
+    for (int i = 0; i < 2 * BENCH_REMOTE_PAIRS; i++)
+        pthread_join(threads[i], NULL);
+    double t1 = now_ns();
+    mm_set_remote_free(false);
+    mm_get_stats(bench_remote_family, &after);
+
+    printf("  %s: %6.2f Mobjects/s, %llu frees queued\n", remote ? "remote free queue" : "mutex only       ",
+           n / (t1 - t0) * 1e3, (unsigned long long)(after.remote_frees - before.remote_frees));
+    bench_print_latency("alloc", alloc_ns, n);
+    bench_print_latency("free ", free_ns, n);
+    free(alloc_ns);
+    free(free_ns);
+}
+
+/* Memory spent per small object: fill a family and divide its pages */
+static void bench_density(const char *name, uint32_t size) {
+    static void *objs[BENCH_DENSITY_OBJECTS];
+    mm_family_handle_t family = mm_instantiate_new_page_family(name, size);
+
+    for (int i = 0; i < BENCH_DENSITY_OBJECTS; i++)
+        objs[i] = xcalloc_h(family, size);
+    uint32_t pages = family_page_count(family);
+    printf("  %3u-byte objects: %6.1f bytes per object (%u pages)\n", size,
+           (double)pages * SYSTEM_PAGE_SIZE / BENCH_DENSITY_OBJECTS, pages);
+    for (int i = 0; i < BENCH_DENSITY_OBJECTS; i++)
+        xfree(objs[i]);
+}
+
+static volatile bool bench_stats_stop;
+
+static void *bench_stats_poller(void *arg) {
+    uint64_t *polls = arg;
+    mm_stats_t stats;
+    while (!bench_stats_stop) {
+        mm_get_global_stats(&stats);
+        (*polls)++;
+        usleep(1000);
+    }
+    return NULL;
+}
+
+/* Cost of a poll, and worker throughput while a thread polls every 1 ms */
+static void bench_stats(void) {
+    mm_family_handle_t family = lookup_page_family_by_name("bench_mt");
+    pthread_t threads[BENCH_STATS_THREADS], poller;
+    mm_stats_t stats;
+
+    double t0 = now_ns();
+    for (int i = 0; i < BENCH_STATS_POLLS; i++)
+        mm_get_stats(family, &stats);
+    double t1 = now_ns();
+    printf("  mm_get_stats: %6.1f ns per call\n", (t1 - t0) / BENCH_STATS_POLLS);
+
+    for (int polling = 0; polling < 2; polling++) {
+        uint64_t polls = 0;
+        bench_stats_stop = false;
+        if (polling)
+            pthread_create(&poller, NULL, bench_stats_poller, &polls);
+        t0 = now_ns();
+        for (int i = 0; i < BENCH_STATS_THREADS; i++)
+            pthread_create(&threads[i], NULL, bench_mt_worker, NULL);
+        for (int i = 0; i < BENCH_STATS_THREADS; i++)
+            pthread_join(threads[i], NULL);
+        t1 = now_ns();
+        bench_stats_stop = true;
+        if (polling)
+            pthread_join(poller, NULL);
+
+        double ops = 2.0 * BENCH_STATS_THREADS * BENCH_MT_ROUNDS * BENCH_MT_BATCH;
+        printf("  %d workers, %-11s %8.2f Mops/s", BENCH_STATS_THREADS,
+               polling ? "polled:" : "unpolled:", ops / (t1 - t0) * 1e3);
+        if (polling)
+            printf("  (%llu global polls)", (unsigned long long)polls);
+        printf("\n");
+    }
+
+    mm_get_stats(family, &stats);
+    printf("  bench_mt: %llu allocs, %llu frees, %llu splits, %llu coalesces, "
+           "internal fragmentation %.1f%%\n",
+           (unsigned long long)stats.allocs, (unsigned long long)stats.frees,
+           (unsigned long long)stats.splits, (unsigned long long)stats.coalesces,
+           stats.internal_fragmentation * 100.0);
+}
+
+/* Churn of 16-512 byte objects; returns ns per alloc or free */
+static double bench_profile_round(mm_family_handle_t family) {
+    static void *slots[BENCH_PROFILE_SLOTS];
+    uint32_t seed = 2024;
+    double t0 = now_ns();
+    for (int op = 0; op < BENCH_PROFILE_OPS; op++) {
+        uint32_t r = bench_rand(&seed);
+        void **slot = &slots[r % BENCH_PROFILE_SLOTS];
+        if (*slot) {
+            xfree(*slot);
+            *slot = NULL;
+        } else {
+            *slot = xmalloc_h(family, 16 + (r >> 12) % 497);
+        }
+    }
+    double t1 = now_ns();
+    for (int i = 0; i < BENCH_PROFILE_SLOTS; i++) {
+        if (slots[i]) xfree(slots[i]);
+        slots[i] = NULL;
+    }
+    return (t1 - t0) / BENCH_PROFILE_OPS;
+}
+
+static void bench_profile(void) {
+    static const uint64_t intervals[3] = { 0, MM_PROFILE_DEFAULT_INTERVAL, 4096 };
+    double best[3] = { 0, 0, 0 };
+    mm_family_handle_t family = mm_instantiate_new_page_family("bench_profile", 64);
+    mm_set_page_family_policy("bench_profile", MM_POLICY_SIZE_CLASS);
+    bench_profile_round(family); /* warm up the pages */
+
+    /* interleave the settings and keep the best of five rounds each */
+    for (int round = 0; round < 5; round++) {
+        for (int i = 0; i < 3; i++) {
+            if (intervals[i])
+                mm_profile_start(intervals[i]);
+            double ns = bench_profile_round(family);
+            if (intervals[i])
+                mm_profile_stop();
+            if (!best[i] || ns < best[i])
+                best[i] = ns;
+        }
+    }
+    double off = best[0], on = best[1], dense = best[2];
+    printf("  off            %6.1f ns/op\n", off);
+    printf("  every %3u KiB  %6.1f ns/op (%+.1f%%)\n", MM_PROFILE_DEFAULT_INTERVAL / 1024, on,
+           100.0 * (on - off) / off);
+    printf("  every   4 KiB  %6.1f ns/op (%+.1f%%)\n", dense, 100.0 * (dense - off) / off);
+}
+
+int main() {
+    printf("=== Heap Manager Benchmarks ===\n");
+
+    mm_init();
+
+    bench_free_100k();
+
+    printf("policy_trace: %d ops over %d slots, 16-512 byte requests\n",
+           BENCH_TRACE_OPS, BENCH_TRACE_SLOTS);
+    bench_policy_trace("bench_heap", MM_POLICY_MAX_HEAP);
+    bench_policy_trace("bench_class", MM_POLICY_SIZE_CLASS);
+    bench_policy_trace("bench_dense", MM_POLICY_DENSE);
+
+    printf("slab_vs_blocks: %d x 32-byte structs\n", BENCH_SLAB_OBJECTS);
+    bench_slab_vs_blocks("bench_block", 0);
+    bench_slab_vs_blocks("bench_slab", 1);
+
+    printf("mt_scaling: alloc/free batches of %d x 64 bytes on one family\n", BENCH_MT_BATCH);
+    MM_REG_STRUCT(bench_mt, 64);
+    bench_mt_scaling(false);
+    bench_mt_scaling(true);
+
+    printf("lookup_vs_handle: %d registered families\n", BENCH_LOOKUP_FAMILIES);
+    bench_lookup_vs_handle();
+
+    printf("page_pingpong: last object on a page freed and reallocated\n");
+    mm_set_global_empty_cache(0, 0);
+    bench_page_pingpong("bench_pp_unmap", 0);
+    mm_set_global_empty_cache(MM_DEFAULT_GLOBAL_EMPTY_LOW, MM_DEFAULT_GLOBAL_EMPTY_HIGH);
+    bench_page_pingpong("bench_pp_cache", MM_DEFAULT_EMPTY_HIGH);
+
+    printf("first_touch: %d x %d-byte objects\n", BENCH_TOUCH_OBJECTS, BENCH_TOUCH_SIZE);
+    bench_first_touch();
+
+    printf("bulk: batches of %d x 48-byte objects\n", BENCH_BULK_BATCH);
+    bench_bulk();
+
+    printf("arena: %d objects of 16-256 bytes per request\n", BENCH_ARENA_OBJECTS);
+    bench_arena();
+
+    printf("realloc: %d buffers grown from 64 bytes to 1 KiB\n", BENCH_REALLOC_BUFFERS);
+    bench_realloc();
+
+    printf("remote_free: %d producer/consumer pairs, %d objects each\n",
+           BENCH_REMOTE_PAIRS, BENCH_REMOTE_OBJECTS);
+    bench_remote_family = mm_instantiate_new_page_family("bench_remote", 32);
+    bench_remote_free(false);
+    bench_remote_free(true);
+
+    printf("density: %d objects, %zu-byte block headers\n",
+           BENCH_DENSITY_OBJECTS, sizeof(block_meta_data_t));
+    bench_density("bench_density_16", 16);
+    bench_density("bench_density_32", 32);
+    bench_density("bench_density_48", 48);
+
+    printf("stats: polling counters during allocation\n");
+    bench_stats();
+
+    printf("profile: %d ops of 16-512 bytes, sampling off and on\n", BENCH_PROFILE_OPS);
+    bench_profile();
+
+    return 0;
+}
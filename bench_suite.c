@@ -0,0 +1,712 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Allocator benchmark suite: lmm against glibc malloc.
+ * Every workload runs once per backend in a forked child, so peak RSS and
+ * page-level fragmentation belong to that run alone. Reported per run:
+ *   ops/s     allocations plus frees per second of wall time
+ *   p50..     latency of a sampled alloc or free, in ns
+ *   RSS KB    peak resident (non-file) memory growth during the workload
+ *   end KB    resident growth at the end, before the last live objects go
+ *   frag      1 - peak live requested bytes / peak RSS growth
+ *
+ * Usage: bench_suite                     all workloads, both backends
+ *        bench_suite WORKLOAD            one workload
+ *        bench_suite record FILE WORKLOAD  run WORKLOAD on lmm, tracing to FILE
+ *        bench_suite replay FILE         replay a trace on glibc and on lmm
+ *                                        under each allocation policy
+ * Options, before the command: -p SIZE[k|m] sets the lmm page size,
+ * -H thp|hugetlb its huge page backing (mm_init_with_page_size) and
+ * -P heap|class|dense the policy of the lmm families.
+ * Workloads: churn, mixed, prodcons, longshort, spike. Build with `make`.
+ * `make bench-preload` runs the suite again with malloc served by
+ * libmm_preload.so; that backend then reports as "preload".
+ * `record FILE spike` then `replay FILE` compares how much memory each
+ * policy gives back once a spike has drained (end KB). */
+
+#define SUITE_SLOTS 20000
+#define SUITE_OPS 2000000
+#define SUITE_SAMPLE_SHIFT 4          /* time one op in 16 */
+#define SUITE_RING 16384
+#define SUITE_LONG_LIVED 50000
+#define SUITE_SHORT_MAX 512
+#define SUITE_SPIKE_OBJECTS 200000
+#define SUITE_SPIKE_BASE 4000         /* slots churned before, during and after the spike */
+#define SUITE_SPIKE_KEEP 1000         /* one spike object in this many stays live */
+
+typedef struct {
+    const char *name;
+    void (*init)(void);
+    void *(*alloc)(uint32_t family, uint32_t size, bool zero);
+    void (*free)(void *ptr);
+} suite_backend_t;
+
+typedef struct {
+    uint64_t ops;
+    uint64_t live;        /* requested bytes currently allocated */
+    uint64_t peak_live;
+    long end_rss_kb;      /* absolute; 0 until run_mark_end */
+    double *samples;
+    uint64_t nsamples;
+    uint64_t max_samples;
+} suite_run_t;
+
+/* ---- backends ---- */
+
+#define SUITE_MAX_FAMILIES 64
+
+static mm_family_handle_t lmm_families[SUITE_MAX_FAMILIES];
+static mm_alloc_policy_t lmm_policy = MM_POLICY_MAX_HEAP;
+static const char *const lmm_policy_names[] = {
+    [MM_POLICY_MAX_HEAP] = "lmm",
+    [MM_POLICY_SIZE_CLASS] = "lmm-class",
+    [MM_POLICY_DENSE] = "lmm-dense",
+};
+
+static void lmm_init(void) {
+    mm_init();
+    mm_set_thread_cache(true);
+    lmm_families[0] = MM_REG_STRUCT(suite, 64);
+    mm_set_page_family_policy("suite", lmm_policy);
+}
+
+static void *lmm_alloc(uint32_t family, uint32_t size, bool zero) {
+    return zero ? xcalloc_h(lmm_families[family], size) : xmalloc_h(lmm_families[family], size);
+}
+
+/* "preload" when malloc itself is lmm's interposer (make bench-preload) */
+static const char *malloc_name = "glibc";
+
+static void glibc_init(void) {
+}
+
+static void *glibc_alloc(uint32_t family, uint32_t size, bool zero) {
+    (void)family;
+    return zero ? calloc(1, size) : malloc(size);
+}
+
+static const suite_backend_t suite_backends[] = {
+    { "lmm", lmm_init, lmm_alloc, xfree },
+    { "glibc", glibc_init, glibc_alloc, free },
+};
+
+/* ---- measurement ---- */
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static uint32_t rng(uint32_t *seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed >> 8;
+}
+
+/* Fault a buffer in now so it is not charged to the workload's RSS */
+static void *prefault(void *buf, size_t bytes) {
+    for (size_t off = 0; off < bytes; off += 4096)
+        ((volatile char *)buf)[off] = ((volatile char *)buf)[off];
+    return buf;
+}
+
+static void run_init(suite_run_t *run, uint64_t ops) {
+    memset(run, 0, sizeof(*run));
+    run->max_samples = (ops >> SUITE_SAMPLE_SHIFT) + 1;
+    run->samples = prefault(malloc(run->max_samples * sizeof(double)), run->max_samples * sizeof(double));
+}
+
+static inline bool run_sampling(suite_run_t *run) {
+    return (run->ops & ((1u << SUITE_SAMPLE_SHIFT) - 1)) == 0 && run->nsamples < run->max_samples;
+}
+
+static inline void *run_alloc(suite_run_t *run, const suite_backend_t *b, uint32_t family,
+                              uint32_t size, bool zero) {
+    void *ptr;
+    if (run_sampling(run)) {
+        double t0 = now_ns();
+        ptr = b->alloc(family, size, zero);
+        run->samples[run->nsamples++] = now_ns() - t0;
+    } else {
+        ptr = b->alloc(family, size, zero);
+    }
+    run->ops++;
+    run->live += size;
+    if (run->live > run->peak_live)
+        run->peak_live = run->live;
+    /* touch the object like a real caller would */
+    *(volatile char *)ptr = 1;
+    return ptr;
+}
+
+static inline void run_free(suite_run_t *run, const suite_backend_t *b, void *ptr, uint32_t size) {
+    if (run_sampling(run)) {
+        double t0 = now_ns();
+        b->free(ptr);
+        run->samples[run->nsamples++] = now_ns() - t0;
+    } else {
+        b->free(ptr);
+    }
+    run->ops++;
+    run->live -= size;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const double *sorted, uint64_t n, double p) {
+    return n ? sorted[(uint64_t)(p * (double)(n - 1))] : 0.0;
+}
+
+/* VmRSS or VmHWM from /proc/self/status, in KB */
+static long proc_status_kb(const char *field) {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (!f) return 0;
+    char line[256];
+    long kb = 0;
+    size_t len = strlen(field);
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, field, len) == 0 && line[len] == ':') {
+            kb = strtol(line + len + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+/* ru_maxrss survives fork and exec, so it can hide a child's own peak;
+ * reset the kernel's high-water mark instead and read it back later.
+ * File pages (library text the child faults back in) only grow and are not
+ * the allocator's doing, so both ends leave them out. */
+static long rss_reset_peak(void) {
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (f) {
+        fputs("5", f);
+        fclose(f);
+    }
+    return proc_status_kb("VmRSS") - proc_status_kb("RssFile");
+}
+
+static long peak_rss_kb(void) {
+    long kb = proc_status_kb("VmHWM");
+    if (!kb) {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        kb = ru.ru_maxrss;
+    }
+    return kb - proc_status_kb("RssFile");
+}
+
+static long rss_now_kb(void) {
+    return proc_status_kb("VmRSS") - proc_status_kb("RssFile");
+}
+
+/* Note the resident size while the workload's final live set is in place */
+static void run_mark_end(suite_run_t *run) {
+    run->end_rss_kb = rss_now_kb();
+}
+
+static void report(const char *workload, const char *backend, suite_run_t *run,
+                   double elapsed_ns, long base_rss_kb) {
+    long rss_kb = peak_rss_kb() - base_rss_kb; /* before qsort's scratch buffer */
+    if (!run->end_rss_kb)
+        run_mark_end(run);
+    long end_kb = run->end_rss_kb - base_rss_kb;
+    qsort(run->samples, run->nsamples, sizeof(double), cmp_double);
+    double frag = rss_kb > 0 ? 1.0 - (double)run->peak_live / ((double)rss_kb * 1024.0) : 0.0;
+    printf("%-10s %-9s %12.0f %8.0f %8.0f %8.0f %10ld %10ld %6.1f%%\n",
+           workload, backend, (double)run->ops * 1e9 / elapsed_ns,
+           percentile(run->samples, run->nsamples, 0.50),
+           percentile(run->samples, run->nsamples, 0.99),
+           percentile(run->samples, run->nsamples, 0.999),
+           rss_kb, end_kb < 0 ? 0 : end_kb, frag < 0 ? 0.0 : frag * 100.0);
+    free(run->samples);
+}
+
+/* ---- synthetic workloads ---- */
+
+typedef struct {
+    void *ptr;
+    uint32_t size;
+} suite_slot_t;
+
+static suite_slot_t *suite_slots;
+
+/* Random slot: free it when occupied, else allocate size_of(r) bytes */
+static inline void churn_step(suite_run_t *run, const suite_backend_t *b, uint32_t slots,
+                              uint32_t *seed, uint32_t (*size_of)(uint32_t r)) {
+    uint32_t r = rng(seed);
+    suite_slot_t *s = &suite_slots[r % slots];
+    if (s->ptr) {
+        run_free(run, b, s->ptr, s->size);
+        s->ptr = NULL;
+    } else {
+        s->size = size_of(r);
+        s->ptr = run_alloc(run, b, 0, s->size, false);
+    }
+}
+
+static void churn_loop(suite_run_t *run, const suite_backend_t *b, uint32_t slots,
+                       uint64_t ops, uint32_t (*size_of)(uint32_t r)) {
+    uint32_t seed = 12345;
+    for (uint64_t i = 0; i < ops; i++)
+        churn_step(run, b, slots, &seed, size_of);
+    run_mark_end(run);
+    for (uint32_t i = 0; i < slots; i++) {
+        if (suite_slots[i].ptr) {
+            run_free(run, b, suite_slots[i].ptr, suite_slots[i].size);
+            suite_slots[i].ptr = NULL;
+        }
+    }
+}
+
+static uint32_t size_fixed64(uint32_t r) {
+    (void)r;
+    return 64;
+}
+
+/* 16..4096 bytes, log-uniform so small objects dominate like real heaps */
+static uint32_t size_mixed(uint32_t r) {
+    uint32_t shift = 4 + (r >> 12) % 9;
+    return (1u << shift) + ((r >> 3) & ((1u << shift) - 1)) / 2;
+}
+
+static uint32_t size_short(uint32_t r) {
+    return 32 + (r >> 10) % (SUITE_SHORT_MAX - 32);
+}
+
+static void workload_churn(suite_run_t *run, const suite_backend_t *b) {
+    churn_loop(run, b, SUITE_SLOTS, SUITE_OPS, size_fixed64);
+}
+
+static void workload_mixed(suite_run_t *run, const suite_backend_t *b) {
+    churn_loop(run, b, SUITE_SLOTS, SUITE_OPS, size_mixed);
+}
+
+/* Long-lived objects allocated up front, interleaved with short-lived
+ * churn, and released only at the end: the pattern that pins pages */
+static void workload_longshort(suite_run_t *run, const suite_backend_t *b) {
+    void **longs = malloc(SUITE_LONG_LIVED * sizeof(void *));
+    uint32_t seed = 777;
+    for (uint32_t i = 0; i < SUITE_LONG_LIVED; i++) {
+        longs[i] = run_alloc(run, b, 0, 48, false);
+        if (i % 8 == 0) {
+            uint32_t size = size_short(rng(&seed));
+            run_free(run, b, run_alloc(run, b, 0, size, false), size);
+        }
+    }
+    churn_loop(run, b, SUITE_SLOTS / 4, SUITE_OPS / 2, size_short);
+    run_mark_end(run);
+    for (uint32_t i = 0; i < SUITE_LONG_LIVED; i++)
+        run_free(run, b, longs[i], 48);
+    free(longs);
+}
+
+/* Spike then idle: a small working set churns steadily, a burst of
+ * short-lived objects piles up on top of it and is freed in random order
+ * except for a few stragglers, then the working set churns on alone. An
+ * allocator that keeps reusing the spike's pages for the idle churn holds
+ * on to them; end KB shows what stays resident once things are quiet. */
+static void workload_spike(suite_run_t *run, const suite_backend_t *b) {
+    suite_slot_t *spike = prefault(malloc(SUITE_SPIKE_OBJECTS * sizeof(suite_slot_t)),
+                                   SUITE_SPIKE_OBJECTS * sizeof(suite_slot_t));
+    uint32_t seed = 4242, spike_seed = 31;
+    for (uint32_t i = 0; i < SUITE_SPIKE_BASE * 4; i++)
+        churn_step(run, b, SUITE_SPIKE_BASE, &seed, size_short);
+
+    for (uint32_t i = 0; i < SUITE_SPIKE_OBJECTS; i++) {
+        spike[i].size = size_short(rng(&spike_seed));
+        spike[i].ptr = run_alloc(run, b, 0, spike[i].size, false);
+        churn_step(run, b, SUITE_SPIKE_BASE, &seed, size_short);
+    }
+    /* shuffle, then free all but the first few */
+    for (uint32_t i = SUITE_SPIKE_OBJECTS - 1; i > 0; i--) {
+        uint32_t j = rng(&spike_seed) % (i + 1);
+        suite_slot_t tmp = spike[i];
+        spike[i] = spike[j];
+        spike[j] = tmp;
+    }
+    uint32_t kept = SUITE_SPIKE_OBJECTS / SUITE_SPIKE_KEEP;
+    for (uint32_t i = kept; i < SUITE_SPIKE_OBJECTS; i++) {
+        run_free(run, b, spike[i].ptr, spike[i].size);
+        churn_step(run, b, SUITE_SPIKE_BASE, &seed, size_short);
+    }
+
+    for (uint64_t i = 0; i < SUITE_OPS / 2; i++)
+        churn_step(run, b, SUITE_SPIKE_BASE, &seed, size_short);
+    run_mark_end(run);
+
+    for (uint32_t i = 0; i < kept; i++)
+        run_free(run, b, spike[i].ptr, spike[i].size);
+    for (uint32_t i = 0; i < SUITE_SPIKE_BASE; i++) {
+        if (suite_slots[i].ptr) {
+            run_free(run, b, suite_slots[i].ptr, suite_slots[i].size);
+            suite_slots[i].ptr = NULL;
+        }
+    }
+    free(spike);
+}
+
+/* Producer/consumer: one thread allocates, another frees, through an SPSC
+ * ring, so every free is cross-thread. Latency is sampled on both sides. */
+typedef struct {
+    const suite_backend_t *b;
+    suite_run_t run;
+    suite_slot_t ring[SUITE_RING];
+    uint64_t freed;             /* bytes released by the consumer */
+    uint64_t head;              /* written by the producer */
+    uint64_t tail;              /* written by the consumer */
+} suite_pc_t;
+
+static void *pc_consumer(void *arg) {
+    suite_pc_t *pc = arg;
+    suite_run_t *run = &pc->run;
+    uint64_t total = SUITE_OPS / 2;
+    for (uint64_t tail = 0; tail < total; tail++) {
+        while (__atomic_load_n(&pc->head, __ATOMIC_ACQUIRE) == tail)
+            sched_yield();
+        suite_slot_t s = pc->ring[tail % SUITE_RING];
+        __atomic_store_n(&pc->tail, tail + 1, __ATOMIC_RELEASE);
+        run_free(run, pc->b, s.ptr, 0);
+        __atomic_fetch_add(&pc->freed, s.size, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+static void workload_prodcons(suite_run_t *run, const suite_backend_t *b) {
+    static suite_pc_t pc;
+    memset(&pc, 0, sizeof(pc));
+    pc.b = b;
+    /* the consumer samples into the back half of the preallocated buffer */
+    run->max_samples /= 2;
+    pc.run.samples = run->samples + run->max_samples;
+    pc.run.max_samples = run->max_samples;
+
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, pc_consumer, &pc);
+    uint32_t seed = 99;
+    uint64_t peak_live = 0;
+    for (uint64_t head = 0; head < SUITE_OPS / 2; head++) {
+        while (head - __atomic_load_n(&pc.tail, __ATOMIC_ACQUIRE) == SUITE_RING)
+            sched_yield();
+        suite_slot_t *s = &pc.ring[head % SUITE_RING];
+        s->size = size_short(rng(&seed));
+        s->ptr = run_alloc(run, b, 0, s->size, false);
+        __atomic_store_n(&pc.head, head + 1, __ATOMIC_RELEASE);
+
+        /* run_alloc only counts allocations; take the consumer's frees off */
+        uint64_t live = run->live - __atomic_load_n(&pc.freed, __ATOMIC_RELAXED);
+        if (live > peak_live)
+            peak_live = live;
+    }
+    pthread_join(consumer, NULL);
+
+    run->peak_live = peak_live;
+    memmove(run->samples + run->nsamples, pc.run.samples, pc.run.nsamples * sizeof(double));
+    run->nsamples += pc.run.nsamples;
+    run->ops += pc.run.ops;
+}
+
+typedef struct {
+    const char *name;
+    void (*fn)(suite_run_t *run, const suite_backend_t *b);
+} suite_workload_t;
+
+static const suite_workload_t suite_workloads[] = {
+    { "churn", workload_churn },
+    { "mixed", workload_mixed },
+    { "prodcons", workload_prodcons },
+    { "longshort", workload_longshort },
+    { "spike", workload_spike },
+};
+
+#define SUITE_NUM_WORKLOADS (sizeof(suite_workloads) / sizeof(suite_workloads[0]))
+#define SUITE_NUM_BACKENDS (sizeof(suite_backends) / sizeof(suite_backends[0]))
+
+static const suite_workload_t *find_workload(const char *name) {
+    for (size_t i = 0; i < SUITE_NUM_WORKLOADS; i++)
+        if (strcmp(suite_workloads[i].name, name) == 0)
+            return &suite_workloads[i];
+    fprintf(stderr, "unknown workload '%s'\n", name);
+    return NULL;
+}
+
+/* ---- trace replay ---- */
+
+typedef struct {
+    uint8_t is_free;
+    uint8_t zero;
+    uint16_t family;
+    uint32_t size;
+    uint32_t slot;
+} suite_op_t;
+
+typedef struct {
+    suite_op_t *ops;
+    uint64_t nops;
+    uint32_t nslots;
+    char (*family_names)[MM_MAX_STRUCT_NAME];
+    uint32_t *family_sizes;
+    uint32_t nfamilies;
+} suite_trace_t;
+
+/* Turn recorded pointers into slot numbers, so a replay pairs each free
+ * with its allocation whatever addresses the backend hands out. Frees of
+ * blocks allocated before recording started are dropped. */
+static int trace_load(const char *path, suite_trace_t *t) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char magic[8];
+    if (fread(magic, 1, 8, f) != 8 || memcmp(magic, MM_TRACE_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s: not an lmm trace\n", path);
+        fclose(f);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    uint64_t nrec = ((uint64_t)ftell(f) - 8) / sizeof(mm_trace_record_t);
+    fseek(f, 8, SEEK_SET);
+    mm_trace_record_t *recs = malloc(nrec * sizeof(*recs) + 1);
+    nrec = fread(recs, sizeof(*recs), nrec, f);
+    fclose(f);
+
+    memset(t, 0, sizeof(*t));
+    t->ops = malloc(nrec * sizeof(suite_op_t) + 1);
+    t->family_names = calloc(SUITE_MAX_FAMILIES, MM_MAX_STRUCT_NAME);
+    t->family_sizes = calloc(SUITE_MAX_FAMILIES, sizeof(uint32_t));
+
+    /* open-addressing map from pointer to live slot (UINT32_MAX: freed) */
+    uint64_t cap = 16;
+    while (cap < nrec * 2) cap <<= 1;
+    uint64_t *keys = calloc(cap, sizeof(uint64_t));
+    uint32_t *vals = malloc(cap * sizeof(uint32_t));
+    uint32_t *free_slots = malloc(nrec * sizeof(uint32_t) + 1);
+    uint32_t nfree_slots = 0;
+
+    for (uint64_t i = 0; i < nrec; i++) {
+        mm_trace_record_t *r = &recs[i];
+        if (r->op == MM_TRACE_FAMILY) {
+            if (r->family_id < SUITE_MAX_FAMILIES) {
+                memcpy(t->family_names[r->family_id], &recs[i + 1], MM_MAX_STRUCT_NAME);
+                t->family_names[r->family_id][MM_MAX_STRUCT_NAME - 1] = '\0';
+                t->family_sizes[r->family_id] = r->size;
+                if (r->family_id >= t->nfamilies)
+                    t->nfamilies = r->family_id + 1;
+            }
+            i += MM_MAX_STRUCT_NAME / sizeof(mm_trace_record_t);
+            continue;
+        }
+        if (r->family_id >= SUITE_MAX_FAMILIES)
+            continue;
+
+        uint64_t h = (r->ptr * 0x9E3779B97F4A7C15ull) >> 20;
+        while (keys[h & (cap - 1)] && keys[h & (cap - 1)] != r->ptr)
+            h++;
+        h &= cap - 1;
+
+        suite_op_t *op = &t->ops[t->nops];
+        if (r->op == MM_TRACE_ALLOC) {
+            keys[h] = r->ptr;
+            vals[h] = nfree_slots ? free_slots[--nfree_slots] : t->nslots++;
+            op->is_free = 0;
+            op->slot = vals[h];
+        } else {
+            if (!keys[h] || vals[h] == UINT32_MAX)
+                continue;
+            op->is_free = 1;
+            op->slot = vals[h];
+            free_slots[nfree_slots++] = vals[h];
+            vals[h] = UINT32_MAX;
+        }
+        op->zero = r->zero;
+        op->family = r->family_id;
+        op->size = r->size;
+        t->nops++;
+    }
+    free(keys);
+    free(vals);
+    free(free_slots);
+    free(recs);
+    return 0;
+}
+
+static suite_trace_t suite_trace;
+
+static void lmm_replay_init(void) {
+    mm_init();
+    mm_set_thread_cache(true);
+    for (uint32_t i = 0; i < suite_trace.nfamilies; i++) {
+        if (!suite_trace.family_names[i][0])
+            snprintf(suite_trace.family_names[i], MM_MAX_STRUCT_NAME, "replay_%u", i);
+        /* the per-node pools of a NUMA family share its name */
+        lmm_families[i] = lookup_page_family_by_name(suite_trace.family_names[i]);
+        if (!lmm_families[i])
+            lmm_families[i] = mm_instantiate_new_page_family(suite_trace.family_names[i],
+                                                             suite_trace.family_sizes[i]);
+        mm_set_page_family_policy(suite_trace.family_names[i], lmm_policy);
+    }
+}
+
+static void workload_replay(suite_run_t *run, const suite_backend_t *b) {
+    void **ptrs = calloc(suite_trace.nslots + 1, sizeof(void *));
+    uint32_t *sizes = calloc(suite_trace.nslots + 1, sizeof(uint32_t));
+    for (uint64_t i = 0; i < suite_trace.nops; i++) {
+        suite_op_t *op = &suite_trace.ops[i];
+        if (op->is_free) {
+            run_free(run, b, ptrs[op->slot], sizes[op->slot]);
+            ptrs[op->slot] = NULL;
+        } else {
+            sizes[op->slot] = op->size;
+            ptrs[op->slot] = run_alloc(run, b, op->family, op->size, op->zero);
+        }
+    }
+    /* objects still live at the end of the trace */
+    run_mark_end(run);
+    for (uint32_t i = 0; i < suite_trace.nslots; i++)
+        if (ptrs[i])
+            run_free(run, b, ptrs[i], sizes[i]);
+    free(ptrs);
+    free(sizes);
+}
+
+/* ---- driver ---- */
+
+static void run_one(const suite_workload_t *w, const suite_backend_t *b) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        b->init();
+        suite_slots = prefault(calloc(SUITE_SLOTS, sizeof(suite_slot_t)), SUITE_SLOTS * sizeof(suite_slot_t));
+        suite_run_t run;
+        run_init(&run, w->fn == workload_replay ? suite_trace.nops : SUITE_OPS);
+        long base_rss_kb = rss_reset_peak();
+
+        double t0 = now_ns();
+        w->fn(&run, b);
+        double elapsed = now_ns() - t0;
+
+        report(w->name, b->name, &run, elapsed, base_rss_kb);
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        printf("%-10s %-9s failed\n", w->name, b->name);
+}
+
+static void print_header(void) {
+    printf("%-10s %-9s %12s %8s %8s %8s %10s %10s %7s\n",
+           "workload", "alloc", "ops/s", "p50 ns", "p99 ns", "p99.9 ns", "RSS KB", "end KB", "frag");
+}
+
+static int cmd_record(const char *path, const char *name) {
+    const suite_workload_t *w = find_workload(name);
+    if (!w) return 1;
+
+    suite_backends[0].init();
+    suite_slots = calloc(SUITE_SLOTS, sizeof(suite_slot_t));
+    suite_run_t run;
+    run_init(&run, SUITE_OPS);
+    if (mm_trace_start(path) != 0)
+        return 1;
+    w->fn(&run, &suite_backends[0]);
+    mm_trace_stop();
+    free(run.samples);
+    printf("recorded %llu ops of '%s' to %s\n", (unsigned long long)run.ops, name, path);
+    return 0;
+}
+
+static int cmd_replay(const char *path) {
+    if (trace_load(path, &suite_trace) != 0)
+        return 1;
+    printf("replay %s: %llu ops, %u slots, %u families\n", path,
+           (unsigned long long)suite_trace.nops, suite_trace.nslots, suite_trace.nfamilies);
+
+    suite_backend_t lmm = suite_backends[0];
+    lmm.init = lmm_replay_init;
+    suite_workload_t w = { "replay", workload_replay };
+    print_header();
+    for (lmm_policy = MM_POLICY_MAX_HEAP; lmm_policy <= MM_POLICY_DENSE; lmm_policy++) {
+        lmm.name = lmm_policy_names[lmm_policy];
+        run_one(&w, &lmm);
+    }
+    suite_backend_t libc = suite_backends[1];
+    libc.name = malloc_name;
+    run_one(&w, &libc);
+    return 0;
+}
+
+static int suite_usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-p SIZE[k|m]] [-H thp|hugetlb] [-P heap|class|dense] "
+            "[WORKLOAD | record FILE WORKLOAD | replay FILE]\n", prog);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    const char *prog = argv[0];
+    size_t page_size = 0;
+    mm_page_backing_t backing = MM_BACKING_DEFAULT;
+    while (argc > 2 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-p") == 0) {
+            char *end;
+            page_size = strtoul(argv[2], &end, 0);
+            if (*end == 'k' || *end == 'K') page_size <<= 10;
+            if (*end == 'm' || *end == 'M') page_size <<= 20;
+        } else if (strcmp(argv[1], "-H") == 0) {
+            backing = strcmp(argv[2], "hugetlb") == 0 ? MM_BACKING_HUGETLB :
+                      strcmp(argv[2], "thp") == 0 ? MM_BACKING_THP : MM_BACKING_DEFAULT;
+        } else if (strcmp(argv[1], "-P") == 0) {
+            lmm_policy = strcmp(argv[2], "dense") == 0 ? MM_POLICY_DENSE :
+                         strcmp(argv[2], "class") == 0 ? MM_POLICY_SIZE_CLASS : MM_POLICY_MAX_HEAP;
+        } else {
+            return suite_usage(prog);
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    const char *preload = getenv("LD_PRELOAD");
+    if (preload && strstr(preload, "libmm_preload"))
+        malloc_name = "preload";
+
+    /* children inherit the setting; their mm_init keeps it */
+    if (mm_init_with_page_size(page_size, backing) != 0) {
+        fprintf(stderr, "page size %zu unavailable with that backing\n", page_size);
+        return 1;
+    }
+
+    if (argc == 4 && strcmp(argv[1], "record") == 0)
+        return cmd_record(argv[2], argv[3]);
+    if (argc == 3 && strcmp(argv[1], "replay") == 0)
+        return cmd_replay(argv[2]);
+    if (argc > 2)
+        return suite_usage(prog);
+
+    if (argc == 2 && !find_workload(argv[1]))
+        return 1;
+    print_header();
+    for (size_t i = 0; i < SUITE_NUM_WORKLOADS; i++) {
+        if (argc == 2 && strcmp(argv[1], suite_workloads[i].name) != 0)
+            continue;
+        for (size_t j = 0; j < SUITE_NUM_BACKENDS; j++) {
+            suite_backend_t b = suite_backends[j];
+            b.name = b.init == lmm_init ? lmm_policy_names[lmm_policy] : malloc_name;
+            run_one(&suite_workloads[i], &b);
+        }
+    }
+    return 0;
+}
@@ -9,92 +9,257 @@
 /* Globals */
 vm_page_for_families_t *first_vm_page_for_families = NULL;
 size_t SYSTEM_PAGE_SIZE = 0;
+static pthread_mutex_t mm_families_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t mm_os_page_size;
+static size_t mm_map_granule;        /* alignment mmap itself guarantees */
+static mm_page_backing_t mm_page_backing = MM_BACKING_DEFAULT;
+static bool mm_hugetlb_warned;
+
+/* name -> family hash index, chained through vm_page_family_t.hash_next */
+static vm_page_family_t *mm_family_hash[MM_FAMILY_HASH_BUCKETS];
+
+static uint32_t mm_family_name_hash(const char *struct_name) {
+    uint32_t h = 2166136261u; /* FNV-1a */
+    for (int i = 0; i < MM_MAX_STRUCT_NAME && struct_name[i]; i++) {
+        h ^= (uint8_t)struct_name[i];
+        h *= 16777619u;
+    }
+    return h & (MM_FAMILY_HASH_BUCKETS - 1);
+}
+
+/* Huge page size the kernel uses for THP and MAP_HUGETLB, 0 if unknown */
+static size_t mm_huge_page_size(void) {
+    unsigned long bytes = 0;
+    FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+    if (f) {
+        if (fscanf(f, "%lu", &bytes) != 1)
+            bytes = 0;
+        fclose(f);
+    }
+    if (!bytes && (f = fopen("/proc/meminfo", "r"))) {
+        char line[128];
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "Hugepagesize: %lu kB", &bytes) == 1) {
+                bytes *= 1024;
+                break;
+            }
+        }
+        fclose(f);
+    }
+    return bytes;
+}
 
-/* Initialize memory manager */
+/* Choose the allocator page size and how it is backed. Every VM page,
+ * slab, large region and family table is one or more of these, aligned to
+ * its own size so masking a pointer still finds its page header. Only
+ * possible before the first family is registered; page_size 0 picks the
+ * OS page, or the huge page size for the huge backings. */
+int mm_init_with_page_size(size_t page_size, mm_page_backing_t backing) {
+    size_t os_page = (size_t)getpagesize();
+    size_t granule = os_page;
+
+    if (backing != MM_BACKING_DEFAULT) {
+        size_t huge = mm_huge_page_size();
+        if (!page_size)
+            page_size = huge;
+        if (backing == MM_BACKING_HUGETLB) {
+            /* hugetlb mappings come in, and are trimmed by, whole huge pages */
+            if (!huge || page_size % huge) return -1;
+            granule = huge;
+        }
+    }
+    if (!page_size)
+        page_size = os_page;
+    if (page_size < os_page || page_size > MM_MAX_VM_PAGE_SIZE || (page_size & (page_size - 1)))
+        return -1;
+
+    pthread_mutex_lock(&mm_families_lock);
+    int rc = 0;
+    if (first_vm_page_for_families &&
+        (page_size != SYSTEM_PAGE_SIZE || backing != mm_page_backing)) {
+        rc = -1; /* pages of the old size are already out there */
+    } else {
+        SYSTEM_PAGE_SIZE = page_size;
+        mm_os_page_size = os_page;
+        mm_map_granule = granule;
+        mm_page_backing = backing;
+    }
+    pthread_mutex_unlock(&mm_families_lock);
+    return rc;
+}
+
+/* Initialize memory manager; keeps a page size chosen earlier */
 void mm_init(void) {
-    SYSTEM_PAGE_SIZE = (size_t)getpagesize();
+    if (!SYSTEM_PAGE_SIZE)
+        mm_init_with_page_size(0, MM_BACKING_DEFAULT);
 }
 
-/* Allocate a new VM page from kernel */
-static void *mm_get_new_vm_page_from_kernel(int units) {
-    size_t bytes = units * SYSTEM_PAGE_SIZE;
-    void *vm_page = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
-                         MAP_ANON | MAP_PRIVATE, -1, 0);
-    if (vm_page == MAP_FAILED) {
-        perror("mmap failed");
+/* mmap bytes at an address aligned to SYSTEM_PAGE_SIZE. mmap only promises
+ * granule alignment, so larger pages over-map and trim the excess. */
+static void *mm_map_aligned(size_t bytes, size_t granule, int extra_flags) {
+    size_t slack = SYSTEM_PAGE_SIZE - granule;
+    char *region = mmap(NULL, bytes + slack, PROT_READ | PROT_WRITE,
+                        MAP_ANON | MAP_PRIVATE | extra_flags, -1, 0);
+    if (region == MAP_FAILED)
         return NULL;
+    if (!slack)
+        return region;
+
+    char *aligned = (char *)(((uintptr_t)region + SYSTEM_PAGE_SIZE - 1) & ~((uintptr_t)SYSTEM_PAGE_SIZE - 1));
+    size_t head = (size_t)(aligned - region);
+    if (head)
+        munmap(region, head);
+    if (slack - head)
+        munmap(aligned + bytes, slack - head);
+    return aligned;
+}
+
+/* Allocate a new VM page from kernel; anonymous memory arrives zeroed,
+ * so it is deliberately not touched here */
+void *mm_get_new_vm_page_from_kernel(int units) {
+    size_t bytes = units * SYSTEM_PAGE_SIZE;
+    void *vm_page = NULL;
+
+    if (mm_page_backing == MM_BACKING_HUGETLB) {
+        vm_page = mm_map_aligned(bytes, mm_map_granule, MAP_HUGETLB);
+        if (!vm_page && !__atomic_exchange_n(&mm_hugetlb_warned, true, __ATOMIC_RELAXED))
+            perror("mmap MAP_HUGETLB failed, falling back to normal pages");
+    }
+    if (!vm_page) {
+        vm_page = mm_map_aligned(bytes, mm_os_page_size, 0);
+        if (!vm_page) {
+            perror("mmap failed");
+            return NULL;
+        }
+        if (mm_page_backing == MM_BACKING_THP)
+            madvise(vm_page, bytes, MADV_HUGEPAGE);
     }
-    memset(vm_page, 0, bytes);
+    mm_stats_note_kernel(true, (uint32_t)units);
     return vm_page;
 }
 
 /* Return VM page to kernel */
-static void mm_return_vm_page_to_kernel(void *vm_page, int units) {
+void mm_return_vm_page_to_kernel(void *vm_page, int units) {
     size_t bytes = units * SYSTEM_PAGE_SIZE;
+    mm_page_map_unregister(vm_page, (uint32_t)units);
     if (munmap(vm_page, bytes) != 0) {
         perror("munmap failed");
+        return;
     }
+    mm_stats_note_kernel(false, (uint32_t)units);
 }
 
-/* Lookup page family by name */
+/* Lookup page family by name through the hash index */
 vm_page_family_t *lookup_page_family_by_name(const char *struct_name) {
-    vm_page_for_families_t *page = first_vm_page_for_families;
-    while (page) {
-        vm_page_family_t *curr = &page->vm_page_family[0];
-        for (uint32_t i = 0; i < ((SYSTEM_PAGE_SIZE - sizeof(vm_page_for_families_t *)) / sizeof(vm_page_family_t)); i++, curr++) {
-            if (curr->struct_size == 0) continue;
-            if (strncmp(curr->struct_name, struct_name, MM_MAX_STRUCT_NAME) == 0)
-                return curr;
-        }
-        page = page->next;
+    vm_page_family_t *curr =
+        __atomic_load_n(&mm_family_hash[mm_family_name_hash(struct_name)], __ATOMIC_ACQUIRE);
+    for (; curr; curr = curr->hash_next) {
+        if (strncmp(curr->struct_name, struct_name, MM_MAX_STRUCT_NAME) == 0)
+            return curr;
     }
     return NULL;
 }
 
-/* Instantiate a new page family */
-void mm_instantiate_new_page_family(const char *struct_name, uint32_t struct_size) {
-    if (struct_size > SYSTEM_PAGE_SIZE) {
-        fprintf(stderr, "SIZE Exceeded\n");
-        return;
-    }
-
+/* Claim and initialize an unused family slot, mapping another family
+ * table page when all are taken. Caller holds mm_families_lock. */
+static vm_page_family_t *mm_family_slot_locked(const char *struct_name, uint32_t struct_size) {
     vm_page_family_t *vm_page_family_curr = NULL;
     vm_page_for_families_t *page_ptr = first_vm_page_for_families;
 
-    while (page_ptr) {
+    while (page_ptr && !vm_page_family_curr) {
         vm_page_family_t *iter = &page_ptr->vm_page_family[0];
-        for (uint32_t i = 0; i < ((SYSTEM_PAGE_SIZE - sizeof(vm_page_for_families_t *)) / sizeof(vm_page_family_t)); i++, iter++) {
-            if (strncmp(iter->struct_name, struct_name, MM_MAX_STRUCT_NAME) == 0) {
-                fprintf(stderr, "Page family already exists\n");
-                return;
-            }
-            if (iter->struct_size == 0 && !vm_page_family_curr)
+        for (uint32_t i = 0; i < MAX_FAMILIES_PER_VM_PAGE; i++, iter++) {
+            if (iter->struct_size == 0) {
                 vm_page_family_curr = iter;
+                break;
+            }
         }
         page_ptr = page_ptr->next;
     }
 
     if (!vm_page_family_curr) {
         vm_page_for_families_t *new_page = (vm_page_for_families_t *)mm_get_new_vm_page_from_kernel(1);
-        if (!new_page) return;
+        if (!new_page)
+            return NULL;
         new_page->next = first_vm_page_for_families;
-        first_vm_page_for_families = new_page;
+        __atomic_store_n(&first_vm_page_for_families, new_page, __ATOMIC_RELEASE);
         vm_page_family_curr = &new_page->vm_page_family[0];
     }
 
     strncpy(vm_page_family_curr->struct_name, struct_name, MM_MAX_STRUCT_NAME - 1);
     vm_page_family_curr->struct_name[MM_MAX_STRUCT_NAME - 1] = '\0';
-    vm_page_family_curr->struct_size = struct_size;
+    pthread_mutex_init(&vm_page_family_curr->lock, NULL);
     vm_page_family_curr->first_page = NULL;
+    vm_page_family_curr->pages_per_refill = MM_DEFAULT_PAGES_PER_REFILL;
+    vm_page_family_curr->empty_low = MM_DEFAULT_EMPTY_LOW;
+    vm_page_family_curr->empty_high = MM_DEFAULT_EMPTY_HIGH;
+    vm_page_family_curr->alignment = MM_MIN_ALIGNMENT;
+    vm_page_family_curr->numa_node = -1;
+    vm_page_family_curr->struct_size = struct_size;
+    return vm_page_family_curr;
 }
 
-/* Allocate a VM page for a family */
-vm_page_t *allocate_vm_page(vm_page_family_t *vm_page_family) {
-    vm_page_t *vm_page = (vm_page_t *)mm_get_new_vm_page_from_kernel(1);
-    if (!vm_page) return NULL;
+/* Create the hidden per-node family behind a NUMA family. It copies the
+ * parent's configuration, is not registered by name, and binds its pages
+ * to node. */
+vm_page_family_t *mm_instantiate_node_family(vm_page_family_t *parent, int node) {
+    pthread_mutex_lock(&mm_families_lock);
+    vm_page_family_t *family = mm_family_slot_locked(parent->struct_name, parent->struct_size);
+    if (family) {
+        family->pages_per_refill = parent->pages_per_refill;
+        family->policy = parent->policy;
+        family->slab_slot_size = parent->slab_slot_size;
+        family->large_threshold = __atomic_load_n(&parent->large_threshold, __ATOMIC_RELAXED);
+        family->empty_low = parent->empty_low;
+        family->empty_high = parent->empty_high;
+        family->alignment = parent->alignment;
+        family->numa_node = node;
+    }
+    pthread_mutex_unlock(&mm_families_lock);
+    return family;
+}
+
+/* Instantiate a new page family; returns its handle, NULL on failure */
+vm_page_family_t *mm_instantiate_new_page_family(const char *struct_name, uint32_t struct_size) {
+    /* structs larger than a page are served by the large-object path */
+    if (struct_size == 0) {
+        fprintf(stderr, "SIZE Invalid\n");
+        return NULL;
+    }
+
+    pthread_mutex_lock(&mm_families_lock);
+
+    if (lookup_page_family_by_name(struct_name)) {
+        fprintf(stderr, "Page family already exists\n");
+        pthread_mutex_unlock(&mm_families_lock);
+        return NULL;
+    }
+
+    vm_page_family_t *vm_page_family_curr = mm_family_slot_locked(struct_name, struct_size);
+    if (!vm_page_family_curr) {
+        pthread_mutex_unlock(&mm_families_lock);
+        return NULL;
+    }
+
+    /* publish last: lookups only see fully initialized families */
+    uint32_t bucket = mm_family_name_hash(vm_page_family_curr->struct_name);
+    vm_page_family_curr->hash_next = mm_family_hash[bucket];
+    __atomic_store_n(&mm_family_hash[bucket], vm_page_family_curr, __ATOMIC_RELEASE);
 
+    pthread_mutex_unlock(&mm_families_lock);
+    return vm_page_family_curr;
+}
+
+/* Format a VM page and link it at the head of the family list.
+ * zeroed says whether everything past the header is known to be zero. */
+static void mm_init_vm_page(vm_page_family_t *vm_page_family, vm_page_t *vm_page, bool zeroed) {
     MARK_VM_PAGE_EMPTY(vm_page);
-    vm_page->block_meta_data.block_size = SYSTEM_PAGE_SIZE - sizeof(vm_page_t);
+    vm_page->clean_offset = zeroed ? (uint32_t)sizeof(vm_page_t) : (uint32_t)SYSTEM_PAGE_SIZE;
+    MM_VM_PAGE_TOUCH(vm_page, sizeof(vm_page_t) + MM_FREE_BLOCK_META_BYTES);
+    vm_page->page_kind = MM_PAGE_BLOCKS;
+    MM_BLOCK_SET_SIZE(&vm_page->block_meta_data, MM_MAX_PAGE_ALLOCATABLE_MEMORY);
+    vm_page->live_blocks = 0;
+    vm_page->free_bytes = MM_MAX_PAGE_ALLOCATABLE_MEMORY;
     vm_page->block_meta_data.offset = (uint32_t)offset_of(vm_page_t, block_meta_data);
 
     vm_page->next = NULL;
@@ -103,22 +268,115 @@ vm_page_t *allocate_vm_page(vm_page_family_t *vm_page_family) {
 
     if (!vm_page_family->first_page) {
         vm_page_family->first_page = vm_page;
-        return vm_page;
+        return;
     }
 
     vm_page->next = vm_page_family->first_page;
     vm_page_family->first_page->prev = vm_page;
     vm_page_family->first_page = vm_page;
-    return vm_page;
 }
 
-/* Free block union */
-void mm_union_free_blocks(block_meta_data_t *first, block_meta_data_t *second) {
-    assert(first->is_free && second->is_free);
-    first->block_size += sizeof(block_meta_data_t) + second->block_size;
+/* Grow a family by one VM page and seed its first block into the free index.
+ * Pages come from the rest of the last refill, then from the empty page
+ * caches, and only then from a fresh mmap of pages_per_refill pages. The
+ * unused part of a refill stays untouched until needed, so a big refill
+ * costs one syscall and no page faults up front; each page is still
+ * formatted independently and can be unmapped on its own.
+ * Returns the number of pages added (0 on failure). */
+uint32_t mm_family_add_vm_pages(vm_page_family_t *vm_page_family) {
+    vm_page_t *vm_page = NULL;
+    bool zeroed = true;
+
+    if (vm_page_family->reserve_count) {
+        vm_page = (vm_page_t *)vm_page_family->reserve_pages;
+        vm_page_family->reserve_pages += SYSTEM_PAGE_SIZE;
+        vm_page_family->reserve_count--;
+    } else {
+        vm_page = (vm_page_t *)mm_page_cache_take(vm_page_family, &zeroed);
+    }
+
+    if (!vm_page) {
+        uint32_t units = vm_page_family->pages_per_refill ?
+                         vm_page_family->pages_per_refill : MM_DEFAULT_PAGES_PER_REFILL;
+        char *region = (char *)mm_get_new_vm_page_from_kernel(units);
+        if (!region) return 0;
+        mm_numa_bind(vm_page_family, region, units * SYSTEM_PAGE_SIZE);
+        MM_STAT_ADD(vm_page_family, mmap_calls, 1);
+        MM_STAT_ADD(vm_page_family, pages_mapped, units);
+        vm_page = (vm_page_t *)region;
+        vm_page_family->reserve_pages = region + SYSTEM_PAGE_SIZE;
+        vm_page_family->reserve_count = units - 1;
+        zeroed = true;
+    }
+    if (mm_page_map_register(vm_page, 1) != 0) {
+        mm_return_vm_page_to_kernel(vm_page, 1);
+        MM_STAT_ADD(vm_page_family, munmap_calls, 1);
+        MM_STAT_ADD(vm_page_family, pages_unmapped, 1);
+        return 0;
+    }
+
+    mm_init_vm_page(vm_page_family, vm_page, zeroed);
+    mm_numa_note_page(vm_page_family, vm_page);
+    mm_free_index_insert(vm_page_family, &vm_page->block_meta_data);
+    return 1;
+}
+
+/* Set how many VM pages a family maps each time it runs out of space */
+int mm_set_page_family_refill(const char *struct_name, uint32_t pages) {
+    vm_page_family_t *family = lookup_page_family_by_name(struct_name);
+    if (!family || pages == 0) return -1;
+    pthread_mutex_lock(&family->lock);
+    family->pages_per_refill = pages;
+    pthread_mutex_unlock(&family->lock);
+    return 0;
+}
+
+/* Choose the allocation policy; only allowed before the family owns pages */
+int mm_set_page_family_policy(const char *struct_name, mm_alloc_policy_t policy) {
+    vm_page_family_t *family = lookup_page_family_by_name(struct_name);
+    if (!family) return -1;
+    pthread_mutex_lock(&family->lock);
+    int rc = family->first_page ? -1 : 0;
+    if (rc == 0)
+        family->policy = policy;
+    pthread_mutex_unlock(&family->lock);
+    return rc;
+}
+
+/* Extend first over second, which directly follows it on the page */
+static inline void mm_merge_block_space(block_meta_data_t *first, block_meta_data_t *second) {
+    MM_BLOCK_SET_SIZE(first, MM_BLOCK_SIZE(first) + sizeof(block_meta_data_t) + MM_BLOCK_SIZE(second));
+#ifndef MM_COMPACT_HEADERS
     first->next_block = second->next_block;
     if (second->next_block)
         second->next_block->prev_block = first;
+#endif
+}
+
+/* Free block union */
+void mm_union_free_blocks(block_meta_data_t *first, block_meta_data_t *second) {
+    assert(MM_BLOCK_IS_FREE(first) && MM_BLOCK_IS_FREE(second));
+    mm_merge_block_space(first, second);
+    /* the absorbed header becomes free space */
+    vm_page_t *vm_page = (vm_page_t *)MM_GET_PAGE_FROM_META_BLOCK(first);
+    vm_page->free_bytes += sizeof(block_meta_data_t);
+    MM_STAT_ADD(vm_page->pg_family, coalesces, 1);
+#ifdef MM_COMPACT_HEADERS
+    MM_BLOCK_SET_FREE(first); /* rewrite the footer at the new end */
+#endif
+}
+
+/* Grow a live block over its free successor, which the caller has already
+ * taken out of the free index. The user data does not move. */
+void mm_absorb_next_block(block_meta_data_t *block, block_meta_data_t *next) {
+    assert(!MM_BLOCK_IS_FREE(block) && MM_BLOCK_IS_FREE(next));
+    vm_page_t *vm_page = (vm_page_t *)MM_GET_PAGE_FROM_META_BLOCK(block);
+    vm_page->free_bytes -= MM_BLOCK_SIZE(next);
+    mm_merge_block_space(block, next);
+#ifdef MM_COMPACT_HEADERS
+    MM_BLOCK_SET_ALLOCATED(block); /* the new successor's prev is live again */
+#endif
+    MM_VM_PAGE_TOUCH(vm_page, block->offset + sizeof(block_meta_data_t) + MM_BLOCK_SIZE(block));
 }
 
 /* Free a block */
@@ -140,33 +398,35 @@ void mm_free_block(vm_page_family_t *family, block_meta_data_t *block) {
     if (!family || !block) return;
 
     /* Prevent double-free */
-    if (block->is_free == MM_TRUE) {
+    if (MM_BLOCK_IS_FREE(block)) {
         // already free — ignore or warn
         // fprintf(stderr, "mm_free_block: double free detected %p\n", (void*)block);
         return;
     }
 
     /* Mark as free */
-    block->is_free = MM_TRUE;
+    MM_VM_PAGE_MARK_FREE((vm_page_t *)MM_GET_PAGE_FROM_META_BLOCK(block), block);
 
-    /* Remove block from heap if somehow present (should normally not be) */
-    mm_remove_block_from_heap(family, block);
+    /* Remove block from free index if somehow present (should normally not be); O(1) check via heap_index */
+    mm_free_index_remove(family, block);
 
-    /* Try merge with next: if next exists and free, remove next from heap and union */
-    if (block->next_block && block->next_block->is_free) {
-        mm_remove_block_from_heap(family, block->next_block);
-        mm_union_free_blocks(block, block->next_block);
+    /* Try merge with next: if next exists and free, remove next from free index and union */
+    block_meta_data_t *next = NEXT_META_BLOCK(block);
+    if (next && MM_BLOCK_IS_FREE(next)) {
+        mm_free_index_remove(family, next);
+        mm_union_free_blocks(block, next);
     }
 
-    /* Try merge with prev: if prev exists and free, remove prev from heap and union into prev */
-    if (block->prev_block && block->prev_block->is_free) {
-        mm_remove_block_from_heap(family, block->prev_block);
-        mm_union_free_blocks(block->prev_block, block);
-        block = block->prev_block; /* merged block is prev_block now */
+    /* Try merge with prev: if prev exists and free, remove prev from free index and union into prev */
+    block_meta_data_t *prev = PREV_FREE_META_BLOCK(block);
+    if (prev) {
+        mm_free_index_remove(family, prev);
+        mm_union_free_blocks(prev, block);
+        block = prev; /* merged block starts at prev now */
     }
 
-    /* Now insert the (possibly merged) free block back into heap */
-    mm_insert_free_block(family, block);
+    /* Now insert the (possibly merged) free block back into the free index */
+    mm_free_index_insert(family, block);
 }
 
 
@@ -179,11 +439,18 @@ static inline int parent(int i) { return (i - 1) / 2; }
 static inline int left(int i) { return 2 * i + 1; }
 static inline int right(int i) { return 2 * i + 2; }
 
+/* Swap two heap slots and keep each block's recorded heap_index in sync */
+static inline void mm_heap_swap(vm_page_family_t *family, int i, int j) {
+    block_meta_data_t *tmp = family->free_block_heap[i];
+    family->free_block_heap[i] = family->free_block_heap[j];
+    family->free_block_heap[j] = tmp;
+    MM_BLOCK_HEAP_INDEX(family->free_block_heap[i]) = (uint32_t)i;
+    MM_BLOCK_HEAP_INDEX(family->free_block_heap[j]) = (uint32_t)j;
+}
+
 void mm_heapify_up(vm_page_family_t *family, int index) {
-    while (index > 0 && family->free_block_heap[parent(index)]->block_size < family->free_block_heap[index]->block_size) {
-        block_meta_data_t *tmp = family->free_block_heap[parent(index)];
-        family->free_block_heap[parent(index)] = family->free_block_heap[index];
-        family->free_block_heap[index] = tmp;
+    while (index > 0 && MM_BLOCK_SIZE(family->free_block_heap[parent(index)]) < MM_BLOCK_SIZE(family->free_block_heap[index])) {
+        mm_heap_swap(family, parent(index), index);
         index = parent(index);
     }
 }
@@ -193,17 +460,15 @@ void mm_heapify_down(vm_page_family_t *family, int index) {
     int l = left(index), r = right(index);
 
     if (l < (int)family->heap_size &&
-        family->free_block_heap[l]->block_size > family->free_block_heap[largest]->block_size)
+        MM_BLOCK_SIZE(family->free_block_heap[l]) > MM_BLOCK_SIZE(family->free_block_heap[largest]))
         largest = l;
 
     if (r < (int)family->heap_size &&
-        family->free_block_heap[r]->block_size > family->free_block_heap[largest]->block_size)
+        MM_BLOCK_SIZE(family->free_block_heap[r]) > MM_BLOCK_SIZE(family->free_block_heap[largest]))
         largest = r;
 
     if (largest != index) {
-        block_meta_data_t *tmp = family->free_block_heap[index];
-        family->free_block_heap[index] = family->free_block_heap[largest];
-        family->free_block_heap[largest] = tmp;
+        mm_heap_swap(family, index, largest);
         mm_heapify_down(family, largest);
     }
 }
@@ -215,20 +480,16 @@ void mm_insert_free_block(vm_page_family_t *family, block_meta_data_t *block) {
                                           family->heap_capacity * sizeof(block_meta_data_t *));
     }
     family->free_block_heap[family->heap_size] = block;
+    MM_BLOCK_HEAP_INDEX(block) = family->heap_size;
     family->heap_size++;
     mm_heapify_up(family, family->heap_size - 1);
 }
 /* Check if all blocks in the VM page are free */
+/* O(1): the page counts its allocated blocks */
 bool mm_is_vm_page_empty(vm_page_t *vm_page) {
-    block_meta_data_t *block = &vm_page->block_meta_data;
-
-    while (block) {
-        if (!block->is_free)
-            return false;
-        block = block->next_block;
-    }
-    return true;
+    return vm_page->live_blocks == 0;
 }
+/* Unlink an empty page from its family and hand it to the empty page cache */
 void mm_vm_page_delete_and_free(vm_page_t *vm_page) {
     vm_page_family_t *vm_page_family = vm_page->pg_family;
 
@@ -241,21 +502,21 @@ void mm_vm_page_delete_and_free(vm_page_t *vm_page) {
     if (vm_page_family->first_page == vm_page)
         vm_page_family->first_page = vm_page->next;
 
-    // Finally free the page to kernel
-    munmap(vm_page, SYSTEM_PAGE_SIZE);
+    // Retain the page for reuse; the cache decides when the kernel gets it back
+    mm_page_cache_put(vm_page_family, vm_page);
 }
+/* O(log n) removal using the slot recorded in the block itself */
 int mm_remove_block_from_heap(vm_page_family_t *family, block_meta_data_t *block) {
-    if (!family || !family->free_block_heap || family->heap_size == 0) return 0;
+    if (!family || !block || family->heap_size == 0) return 0;
 
-    uint32_t idx = UINT32_MAX;
-    for (uint32_t i = 0; i < family->heap_size; ++i) {
-        if (family->free_block_heap[i] == block) { idx = i; break; }
-    }
-    if (idx == UINT32_MAX) return 0;
+    uint32_t idx = MM_BLOCK_HEAP_INDEX(block);
+    if (idx >= family->heap_size || family->free_block_heap[idx] != block) return 0;
 
     /* Replace with last element and shrink heap, then restore heap property */
     family->free_block_heap[idx] = family->free_block_heap[family->heap_size - 1];
+    MM_BLOCK_HEAP_INDEX(family->free_block_heap[idx]) = idx;
     family->heap_size--;
+    MM_BLOCK_HEAP_INDEX(block) = MM_HEAP_INDEX_NONE;
     if (idx < family->heap_size) {
         /* Try heapify down then up to restore order */
         mm_heapify_down(family, (int)idx);
@@ -7,6 +7,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include<stdbool.h>
+#include <pthread.h>
+#include <sys/types.h>
 
 /* boolean type */
 typedef enum {
@@ -15,46 +17,406 @@ typedef enum {
 } vm_bool_t;
 
 #define MM_MAX_STRUCT_NAME 32
+#define MM_MAX_VM_PAGE_SIZE (1u << 30) /* block sizes and offsets are 32-bit */
+#define MM_NUMA_MAX_NODES 8    /* per-node pools per family; higher nodes fold */
+#define MM_DEFAULT_PAGES_PER_REFILL 1
+#define MM_HEAP_INDEX_NONE UINT32_MAX
+#define MM_SIZE_CLASSES 32
+#define MM_SIZE_CLASS_SCAN_LIMIT 8
+#define MM_DENSE_SCAN_LIMIT 16 /* candidates MM_POLICY_DENSE compares per allocation */
+#define MM_FAMILY_HASH_BUCKETS 256 /* power of two */
+#define MM_DEFAULT_EMPTY_LOW 1         /* empty pages a family keeps after trimming */
+#define MM_DEFAULT_EMPTY_HIGH 4        /* empty pages a family may retain */
+#define MM_DEFAULT_GLOBAL_EMPTY_LOW 32
+#define MM_DEFAULT_GLOBAL_EMPTY_HIGH 128
+#define MM_GLOBAL_EMPTY_PAGES_MAX 1024
+#define MM_TCACHE_FAMILIES 8   /* families cached per thread */
+#define MM_TCACHE_DEPTH 32     /* blocks cached per family per thread */
+#define MM_TCACHE_MAX_SLACK 64 /* largest unused tail accepted on a cache hit */
+#define MM_MIN_ALIGNMENT 8u    /* every block's user data is at least this aligned */
+#define MM_MAX_ALIGNMENT 256u
+#define MM_TCACHE_STATS_BATCH 64 /* thread cache hits counted per shared counter update */
+#define MM_PROFILE_DEFAULT_INTERVAL (512u * 1024) /* mean bytes between profile samples */
+
+/* how a family picks the free block for an allocation */
+typedef enum {
+    MM_POLICY_MAX_HEAP,   /* worst-fit: always split the largest free block */
+    MM_POLICY_SIZE_CLASS, /* segregated power-of-two free lists */
+    MM_POLICY_DENSE       /* size-class lists that favour the fullest pages */
+} mm_alloc_policy_t;
+
+/* policies whose free index is the size-class lists */
+#define MM_POLICY_HAS_SIZE_CLASSES(policy) ((policy) != MM_POLICY_MAX_HEAP)
+
+/* what a VM page is used for; first field of every page header so xfree
+ * can tell page layouts apart from the page-aligned address alone */
+typedef enum {
+    MM_PAGE_BLOCKS = 1, /* vm_page_t carved into variable-size blocks */
+    MM_PAGE_SLAB,       /* mm_slab_t carved into fixed-size slots */
+    MM_PAGE_LARGE,      /* mm_large_region_t spanning one or more pages */
+    MM_PAGE_ARENA       /* mm_arena_chunk_t bump-allocated by an arena */
+} mm_page_kind_t;
 
 /* forward declarations */
 typedef struct vm_page_ vm_page_t;
+typedef struct mm_slab_ mm_slab_t;
+typedef struct mm_large_region_ mm_large_region_t;
 typedef struct block_meta_data_ block_meta_data_t;
 
 /* block metadata */
+#ifdef MM_COMPACT_HEADERS
+/* Compact 8-byte header: the size shares a word with the state bits and the
+ * block list is implicit. The next block sits right after the user data;
+ * a free block stores its size in a boundary-tag footer (its last 4 bytes)
+ * and sets MM_BLOCK_PREV_FREE in its successor, so only free predecessors
+ * are reachable, which is all coalescing needs. A free block keeps its
+ * heap index in its payload, after the free-list links. */
+typedef struct block_meta_data_ {
+    uint32_t size_flags; /* size of user-data area | MM_BLOCK_* bits */
+    uint32_t offset;     /* offset from start of page */
+} __attribute__((aligned(8))) block_meta_data_t;
+#else
 typedef struct block_meta_data_ {
     vm_bool_t is_free;
     uint32_t block_size; /* size of user-data area */
     uint32_t offset;     /* offset from start of page */
+    uint32_t heap_index; /* heap slot (or size class) in the family free index, MM_HEAP_INDEX_NONE if absent */
     struct block_meta_data_ *prev_block;
     struct block_meta_data_ *next_block;
 } block_meta_data_t;
+#endif
+
+/* Allocator statistics as reported by mm_get_stats / mm_get_global_stats.
+ * Byte counts are usable bytes, so headers and rounding show up in
+ * internal_fragmentation rather than in bytes_in_use. Blocks parked in
+ * thread caches still count as in use. */
+typedef struct mm_stats_ {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t bytes_in_use;       /* usable bytes of live allocations */
+    uint64_t peak_bytes_in_use;
+    uint64_t bytes_requested;    /* cumulative, what callers asked for */
+    uint64_t bytes_granted;      /* cumulative, what they got */
+    uint64_t pages_mapped;       /* VM pages obtained from the kernel */
+    uint64_t pages_unmapped;     /* VM pages given back to the kernel */
+    uint64_t mmap_calls;
+    uint64_t munmap_calls;
+    uint64_t splits;
+    uint64_t coalesces;
+    uint64_t reallocs;
+    uint64_t realloc_grows_in_place;   /* grew into the free block after it */
+    uint64_t realloc_shrinks_in_place; /* ... or kept its place while shrinking */
+    uint64_t remote_frees;       /* frees queued because the family lock was busy */
+    uint64_t heap_size;          /* free blocks in the free index */
+    uint64_t largest_free_block;
+    uint64_t numa_local_allocs;  /* served by a page on the caller's node (NUMA families) */
+    uint64_t numa_remote_allocs; /* served by a page on another node */
+    uint64_t numa_remote_frees;  /* freed by a thread on another node */
+    uint64_t numa_local_pages;   /* pages that landed on their pool's node */
+    uint64_t numa_remote_pages;  /* ... and pages the kernel placed elsewhere */
+    double internal_fragmentation; /* 1 - bytes_requested / bytes_granted */
+} mm_stats_t;
+
+/* Always-on family counters. Everything but the tcache_*, remote_frees and numa_*_allocs/frees
+ * fields is only written under the family lock, so plain relaxed stores
+ * suffice; readers load them without the lock. Thread caches add their
+ * hits in batches. */
+typedef struct mm_family_stats_ {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t bytes_in_use;
+    uint64_t peak_bytes_in_use;
+    uint64_t bytes_requested;
+    uint64_t bytes_granted;
+    uint64_t pages_mapped;
+    uint64_t pages_unmapped;
+    uint64_t mmap_calls;
+    uint64_t munmap_calls;
+    uint64_t splits;
+    uint64_t coalesces;
+    uint64_t reallocs;
+    uint64_t realloc_grows_in_place;
+    uint64_t realloc_shrinks_in_place;
+    uint64_t free_blocks;
+    uint64_t tcache_allocs;      /* atomic adds, no lock */
+    uint64_t tcache_frees;
+    uint64_t remote_frees;       /* atomic adds, no lock */
+    uint64_t numa_local_allocs;  /* atomic adds, no lock */
+    uint64_t numa_remote_allocs;
+    uint64_t numa_remote_frees;
+    uint64_t numa_local_pages;
+    uint64_t numa_remote_pages;
+} mm_family_stats_t;
+
+/* Allocation trace file (mm_trace.c): MM_TRACE_MAGIC, then fixed-size
+ * records. A MM_TRACE_FAMILY record introduces family_id (size holds the
+ * struct size) and is followed by MM_MAX_STRUCT_NAME bytes of name. */
+#define MM_TRACE_MAGIC "LMMTRC01"
+
+typedef enum {
+    MM_TRACE_FAMILY = 1,
+    MM_TRACE_ALLOC,
+    MM_TRACE_FREE
+} mm_trace_op_t;
+
+typedef struct mm_trace_record_ {
+    uint8_t op;         /* mm_trace_op_t */
+    uint8_t zero;       /* MM_TRACE_ALLOC: calloc semantics */
+    uint16_t family_id;
+    uint32_t size;      /* bytes requested; 0 for frees */
+    uint64_t ptr;       /* user pointer, pairs frees with allocations */
+} mm_trace_record_t;
+
+/* Heap snapshot stream (mm_snapshot.c): MM_SNAPSHOT_MAGIC, then records,
+ * each a mm_snapshot_record_t followed by len payload bytes. Per family:
+ * one FAMILY record, then its PAGE, SLAB and LARGE records, then
+ * FREE_SIZES records listing the free index in index order. */
+#define MM_SNAPSHOT_MAGIC "LMMSNP01"
+#define MM_SNAPSHOT_HIST_BINS 16    /* free blocks by power-of-two size */
+
+typedef enum {
+    MM_SNAPSHOT_FAMILY = 1,
+    MM_SNAPSHOT_PAGE,
+    MM_SNAPSHOT_SLAB,
+    MM_SNAPSHOT_LARGE,
+    MM_SNAPSHOT_FREE_SIZES          /* payload: uint32_t sizes */
+} mm_snapshot_type_t;
+
+typedef struct mm_snapshot_record_ {
+    uint16_t type;                  /* mm_snapshot_type_t */
+    uint16_t reserved;
+    uint32_t len;
+} mm_snapshot_record_t;
+
+typedef struct mm_snapshot_family_ {
+    char name[MM_MAX_STRUCT_NAME];
+    uint32_t struct_size;
+    uint32_t policy;
+    uint32_t alignment;
+    uint32_t slab_slot_size;
+    uint32_t page_size;
+    uint32_t page_capacity;         /* bytes for blocks and their headers */
+    uint32_t block_header;          /* sizeof(block_meta_data_t) */
+    uint32_t empty_pages;           /* retained in the family's empty cache */
+    uint32_t reserve_pages;         /* mapped, not yet formatted */
+    uint32_t free_blocks;
+    uint32_t free_hist[MM_SNAPSHOT_HIST_BINS];
+    uint64_t bytes_in_use;
+} mm_snapshot_family_t;
+
+typedef struct mm_snapshot_page_ {
+    uint64_t addr;
+    uint32_t live_blocks;
+    uint32_t free_blocks;
+    uint32_t live_bytes;            /* user bytes of allocated blocks */
+    uint32_t free_bytes;
+    uint32_t largest_free;
+    uint32_t reserved;
+} mm_snapshot_page_t;
+
+typedef struct mm_snapshot_slab_ {
+    uint64_t addr;
+    uint32_t slot_count;
+    uint32_t free_count;
+} mm_snapshot_slab_t;
+
+typedef struct mm_snapshot_large_ {
+    uint64_t addr;
+    uint32_t pages;
+    uint32_t user_size;
+} mm_snapshot_large_t;
+
+/* bump a lock-protected counter so lock-free readers never see a torn value */
+#define MM_STAT_ADD(family_ptr, field, n) \
+    __atomic_store_n(&(family_ptr)->stats.field, (family_ptr)->stats.field + (n), __ATOMIC_RELAXED)
+#define MM_STAT_SUB(family_ptr, field, n) \
+    __atomic_store_n(&(family_ptr)->stats.field, (family_ptr)->stats.field - (n), __ATOMIC_RELAXED)
+
+/* how allocator pages are backed (mm_init_with_page_size) */
+typedef enum {
+    MM_BACKING_DEFAULT,
+    MM_BACKING_THP,         /* madvise(MADV_HUGEPAGE) on every mapping */
+    MM_BACKING_HUGETLB      /* MAP_HUGETLB, falling back to normal pages */
+} mm_page_backing_t;
 
 /* page family */
 typedef struct vm_page_family_ {
     char struct_name[MM_MAX_STRUCT_NAME];
+    pthread_mutex_t lock;                // guards pages, free index and slabs
+    struct vm_page_family_ *hash_next;   // next family in the same name-hash bucket
     uint32_t struct_size;
     vm_page_t *first_page;
     block_meta_data_t **free_block_heap; // max-heap of free blocks
     uint32_t heap_size;                  // number of blocks
     uint32_t heap_capacity;
+    uint32_t pages_per_refill;           // VM pages mapped per growth step
+    char *reserve_pages;                 // mapped but not yet formatted pages of the last refill
+    uint32_t reserve_count;
+    mm_alloc_policy_t policy;
+    uint32_t size_class_bitmap;          // bit c set while size_class_head[c] is non-empty
+    block_meta_data_t *size_class_head[MM_SIZE_CLASSES];
+    block_meta_data_t *size_class_tail[MM_SIZE_CLASSES];
+    uint32_t slab_slot_size;             // non-zero when the family is in slab mode
+    mm_slab_t *partial_slabs;            // slabs with at least one free slot
+    mm_slab_t *full_slabs;
+    uint32_t large_threshold;            // 0: anything that does not fit a page
+    mm_large_region_t *large_regions;
+    void *empty_pages;                   // retained empty VM pages, linked in-band
+    uint32_t empty_count;
+    uint32_t empty_low;                  // trim down to this many ...
+    uint32_t empty_high;                 // ... once more than this many are retained
+    uint32_t alignment;                  // default user-data alignment, power of two
+    mm_family_stats_t stats;
+    uint32_t trace_gen;                  // trace session that last saw the family
+    uint16_t trace_id;
+    int32_t numa_node;                   // node this family's pages are bound to, -1: none
+    uint32_t numa_nodes;                 // non-zero: allocations go to numa_family[node]
+    struct vm_page_family_ *numa_family[MM_NUMA_MAX_NODES];
+    void *remote_frees;                  // blocks freed while the lock was busy, linked in-band
+    void *profile;                       // live profile samples (mm_profile.c), created on first sample
 } vm_page_family_t;
 
+/* opaque handle returned at registration, used by the *_h allocation API */
+typedef vm_page_family_t *mm_family_handle_t;
+
 /* VM page structure */
 typedef struct vm_page_ {
+    mm_page_kind_t page_kind; /* MM_PAGE_BLOCKS */
+    int32_t numa_node;        /* node the page landed on; NUMA pools only */
     struct vm_page_ *next;
     struct vm_page_ *prev;
     vm_page_family_t *pg_family;
+    uint32_t clean_offset;    /* bytes from here to the page end are known zero */
+    uint32_t live_blocks;     /* allocated blocks on the page */
+    uint32_t free_bytes;      /* user bytes held by free blocks on the page */
     block_meta_data_t block_meta_data; /* first block metadata */
     char page_memory[0]; /* flexible array */
 } vm_page_t;
 
+/* slab page: fixed-size slots without per-object metadata */
+typedef struct mm_slab_ {
+    mm_page_kind_t page_kind; /* MM_PAGE_SLAB */
+    uint32_t slot_count;
+    uint32_t free_count;
+    uint32_t next_unused;     /* slots from here on were never handed out */
+    struct mm_slab_ *next;
+    struct mm_slab_ *prev;
+    vm_page_family_t *pg_family;
+    void *free_list;          /* freed slots, linked through their first word */
+    uint64_t *free_map;       /* bit per slot, set while the slot is free; at the page end */
+    vm_bool_t zeroed;         /* never-used slots are known zero */
+    int32_t numa_node;        /* node the page landed on; NUMA pools only */
+    char slots[0] __attribute__((aligned(16)));
+} mm_slab_t;
+
+/* dedicated multi-page mapping for one large allocation */
+typedef struct mm_large_region_ {
+    mm_page_kind_t page_kind; /* MM_PAGE_LARGE */
+    uint32_t units;           /* VM pages in the mapping */
+    uint32_t user_size;       /* bytes requested */
+    int32_t numa_node;        /* node the first page landed on; NUMA pools only */
+    uint32_t user_offset;     /* where the user pointer starts in the region */
+    struct mm_large_region_ *next;
+    struct mm_large_region_ *prev;
+    vm_page_family_t *pg_family;
+    char user_data[0] __attribute__((aligned(16)));
+} mm_large_region_t;
+
+/* arena chunk: one VM page, or a dedicated run of pages for an object
+ * that does not fit one; objects carry no header */
+typedef struct mm_arena_chunk_ {
+    mm_page_kind_t page_kind; /* MM_PAGE_ARENA */
+    uint32_t units;           /* VM pages in the chunk */
+    uint32_t used;            /* bytes of data handed out */
+    uint32_t dirty;           /* bytes of data possibly non-zero */
+    struct mm_arena_chunk_ *next;
+    struct mm_arena_ *arena;
+    char data[0] __attribute__((aligned(16)));
+} mm_arena_chunk_t;
+
+/* scoped arena; lives at the start of its first chunk's data */
+typedef struct mm_arena_ {
+    mm_arena_chunk_t *current;  /* chunk being bump-allocated, always a single page */
+    mm_arena_chunk_t *full;     /* single-page chunks filled since the last reset */
+    mm_arena_chunk_t *spare;    /* single-page chunks kept by mm_arena_reset */
+    mm_arena_chunk_t *oversized;
+    uint64_t bytes_allocated;   /* since the last reset */
+    uint32_t pages;             /* VM pages held, spares included */
+} mm_arena_t;
+
+/* free-list links kept in the user-data area of a free block */
+typedef struct mm_free_link_ {
+    block_meta_data_t *next;
+    block_meta_data_t *prev;
+} mm_free_link_t;
+
+#define MM_FREE_LINK(block_meta_data_ptr) \
+    ((mm_free_link_t *)((block_meta_data_t *)(block_meta_data_ptr) + 1))
+
+/* block sizes are multiples of 8, leaving the low bits for state */
+#define MM_BLOCK_FREE      1u
+#define MM_BLOCK_PREV_FREE 2u
+#define MM_BLOCK_FLAGS     7u
+
+/* header accessors; the rest of the allocator goes through these */
+#ifdef MM_COMPACT_HEADERS
+#define MM_BLOCK_SIZE(block_ptr) ((block_ptr)->size_flags & ~MM_BLOCK_FLAGS)
+#define MM_BLOCK_SET_SIZE(block_ptr, size) \
+    ((block_ptr)->size_flags = (uint32_t)(size) | ((block_ptr)->size_flags & MM_BLOCK_FLAGS))
+#define MM_BLOCK_IS_FREE(block_ptr) (((block_ptr)->size_flags & MM_BLOCK_FREE) != 0)
+#define MM_BLOCK_HEAP_INDEX(block_ptr) \
+    (*(uint32_t *)((char *)MM_FREE_LINK(block_ptr) + sizeof(mm_free_link_t)))
+#define MM_BLOCK_FOOTER(block_ptr) \
+    (*(uint32_t *)((char *)((block_ptr) + 1) + MM_BLOCK_SIZE(block_ptr) - sizeof(uint32_t)))
+#define MM_BLOCK_IS_LAST(block_ptr) \
+    ((block_ptr)->offset + sizeof(block_meta_data_t) + MM_BLOCK_SIZE(block_ptr) >= SYSTEM_PAGE_SIZE)
+
+/* payload bytes of a free block written by the allocator itself */
+#define MM_FREE_BLOCK_META_BYTES ((uint32_t)(sizeof(mm_free_link_t) + sizeof(uint32_t)))
+/* links, heap index and footer must fit once the block is freed */
+#define MM_MIN_BLOCK_PAYLOAD (MM_FREE_BLOCK_META_BYTES + (uint32_t)sizeof(uint32_t))
+
+/* the footer is only read through a successor, so the last block has none */
+#define MM_BLOCK_SET_FREE(block_ptr) \
+    do { \
+        (block_ptr)->size_flags |= MM_BLOCK_FREE; \
+        if (!MM_BLOCK_IS_LAST(block_ptr)) { \
+            MM_BLOCK_FOOTER(block_ptr) = MM_BLOCK_SIZE(block_ptr); \
+            NEXT_META_BLOCK_BY_SIZE(block_ptr)->size_flags |= MM_BLOCK_PREV_FREE; \
+        } \
+    } while (0)
+
+#define MM_BLOCK_SET_ALLOCATED(block_ptr) \
+    do { \
+        (block_ptr)->size_flags &= ~MM_BLOCK_FREE; \
+        if (!MM_BLOCK_IS_LAST(block_ptr)) \
+            NEXT_META_BLOCK_BY_SIZE(block_ptr)->size_flags &= ~MM_BLOCK_PREV_FREE; \
+    } while (0)
+#else
+#define MM_BLOCK_SIZE(block_ptr) ((block_ptr)->block_size)
+#define MM_BLOCK_SET_SIZE(block_ptr, size) ((block_ptr)->block_size = (uint32_t)(size))
+#define MM_BLOCK_IS_FREE(block_ptr) ((block_ptr)->is_free == MM_TRUE)
+#define MM_BLOCK_HEAP_INDEX(block_ptr) ((block_ptr)->heap_index)
+#define MM_BLOCK_IS_LAST(block_ptr) ((block_ptr)->next_block == NULL)
+#define MM_BLOCK_SET_FREE(block_ptr) ((block_ptr)->is_free = MM_TRUE)
+#define MM_BLOCK_SET_ALLOCATED(block_ptr) ((block_ptr)->is_free = MM_FALSE)
+
+#define MM_FREE_BLOCK_META_BYTES 0u
+/* every block must be able to hold its free-list links once freed */
+#define MM_MIN_BLOCK_PAYLOAD ((uint32_t)sizeof(mm_free_link_t))
+#endif
+#define MM_ALIGN_REQ_SIZE(size) \
+    ((size) < MM_MIN_BLOCK_PAYLOAD ? MM_MIN_BLOCK_PAYLOAD : (((size) + 7u) & ~7u))
+
 /* page storing families */
 typedef struct vm_page_for_families {
     struct vm_page_for_families *next;
     vm_page_family_t vm_page_family[0];
 } vm_page_for_families_t;
 
-vm_page_t *allocate_vm_page(vm_page_family_t *vm_page_family);
+void *mm_get_new_vm_page_from_kernel(int units);
+void mm_return_vm_page_to_kernel(void *vm_page, int units);
+uint32_t mm_family_add_vm_pages(vm_page_family_t *vm_page_family);
 
 /* global state */
 extern vm_page_for_families_t *first_vm_page_for_families;
@@ -62,14 +424,54 @@ extern size_t SYSTEM_PAGE_SIZE;
 
 /* macros */
 #define MM_REG_STRUCT(name, size) mm_instantiate_new_page_family(#name, size)
+#define MM_REG_STRUCT_SLAB(name, size) mm_instantiate_new_slab_family(#name, size)
+#define MM_REG_STRUCT_ALIGNED(name, size, alignment) \
+    mm_instantiate_new_aligned_family(#name, size, alignment)
+#ifdef MM_COMPACT_HEADERS
+#define MARK_VM_PAGE_EMPTY(vm_page_ptr)      \
+    do {                                     \
+        (vm_page_ptr)->block_meta_data.size_flags = MM_BLOCK_FREE; \
+        MM_BLOCK_HEAP_INDEX(&(vm_page_ptr)->block_meta_data) = MM_HEAP_INDEX_NONE; \
+    } while (0)
+#else
 #define MARK_VM_PAGE_EMPTY(vm_page_ptr)      \
     do {                                     \
         (vm_page_ptr)->block_meta_data.next_block = NULL; \
         (vm_page_ptr)->block_meta_data.prev_block = NULL; \
         (vm_page_ptr)->block_meta_data.is_free = MM_TRUE; \
+        (vm_page_ptr)->block_meta_data.heap_index = MM_HEAP_INDEX_NONE; \
+    } while (0)
+#endif
+
+/* record that bytes below end_offset of a page may now be non-zero */
+#define MM_VM_PAGE_TOUCH(vm_page_ptr, end_offset) \
+    do { \
+        uint32_t __end = (uint32_t)(end_offset); \
+        if (__end > (vm_page_ptr)->clean_offset) \
+            (vm_page_ptr)->clean_offset = __end; \
+    } while (0)
+
+/* block state transitions, keeping the page occupancy counters in step */
+#define MM_VM_PAGE_MARK_ALLOCATED(vm_page_ptr, block_ptr) \
+    do { \
+        MM_BLOCK_SET_ALLOCATED(block_ptr); \
+        (vm_page_ptr)->live_blocks++; \
+        (vm_page_ptr)->free_bytes -= MM_BLOCK_SIZE(block_ptr); \
+    } while (0)
+
+#define MM_VM_PAGE_MARK_FREE(vm_page_ptr, block_ptr) \
+    do { \
+        MM_BLOCK_SET_FREE(block_ptr); \
+        MM_BLOCK_HEAP_INDEX(block_ptr) = MM_HEAP_INDEX_NONE; \
+        (vm_page_ptr)->live_blocks--; \
+        (vm_page_ptr)->free_bytes += MM_BLOCK_SIZE(block_ptr); \
     } while (0)
 
 #define OFFSET_OF(struct_type, field_name) ((size_t)&(((struct_type *)0)->field_name))
+#define MM_GET_PAGE_HDR_FROM_PTR(ptr) \
+    ((void *)((uintptr_t)(ptr) & ~((uintptr_t)SYSTEM_PAGE_SIZE - 1)))
+#define MM_PAGE_KIND(page_hdr_ptr) (*(mm_page_kind_t *)(page_hdr_ptr))
+
 #define MM_GET_PAGE_FROM_BLOCK(block_ptr)  \
     ((vm_page_t *)((char *)(block_ptr) - OFFSET_OF(vm_page_t, block_meta_data)))
 
@@ -81,15 +483,43 @@ extern size_t SYSTEM_PAGE_SIZE;
 #define MM_GET_PAGE_FROM_META_BLOCK(block_meta_data_ptr) \
     ((void *)((char *)block_meta_data_ptr - (block_meta_data_ptr)->offset))
 
+#define NEXT_META_BLOCK_BY_SIZE(block_meta_data_ptr) \
+    ((block_meta_data_t *)((char *)((block_meta_data_ptr) + 1) + MM_BLOCK_SIZE(block_meta_data_ptr)))
+
+#ifdef MM_COMPACT_HEADERS
 #define NEXT_META_BLOCK(block_meta_data_ptr) \
-    ((block_meta_data_ptr)->next_block)
+    (MM_BLOCK_IS_LAST(block_meta_data_ptr) ? NULL : NEXT_META_BLOCK_BY_SIZE(block_meta_data_ptr))
 
-#define NEXT_META_BLOCK_BY_SIZE(block_meta_data_ptr) \
-    ((block_meta_data_t *)((char *)((block_meta_data_ptr) + 1) + (block_meta_data_ptr)->block_size))
+/* previous block if it is free, found through its footer; NULL otherwise */
+#define PREV_FREE_META_BLOCK(block_meta_data_ptr) \
+    (((block_meta_data_ptr)->size_flags & MM_BLOCK_PREV_FREE) ? \
+     (block_meta_data_t *)((char *)(block_meta_data_ptr) - *((uint32_t *)(block_meta_data_ptr) - 1) - \
+                           sizeof(block_meta_data_t)) : NULL)
+#else
+#define NEXT_META_BLOCK(block_meta_data_ptr) \
+    ((block_meta_data_ptr)->next_block)
 
 #define PREV_META_BLOCK(block_meta_data_ptr) \
     ((block_meta_data_ptr)->prev_block)
 
+#define PREV_FREE_META_BLOCK(block_meta_data_ptr) \
+    (PREV_META_BLOCK(block_meta_data_ptr) && MM_BLOCK_IS_FREE(PREV_META_BLOCK(block_meta_data_ptr)) ? \
+     PREV_META_BLOCK(block_meta_data_ptr) : NULL)
+#endif
+
+/* largest user-data area a single VM page can hold */
+#define MM_MAX_PAGE_ALLOCATABLE_MEMORY \
+    ((uint32_t)(SYSTEM_PAGE_SIZE - sizeof(vm_page_t)))
+
+/* whether an aligned request might fit no page: the fragment in front of
+ * it and the rounding behind it come on top of the block, so such
+ * requests take the large path */
+#define MM_ALLOC_NEEDS_REGION(units, alignment) \
+    ((alignment) > MM_MIN_ALIGNMENT && \
+     ((alignment) > MM_MAX_ALIGNMENT || \
+      (uint64_t)(units) + 2 * (uint64_t)(alignment) + sizeof(block_meta_data_t) + MM_MIN_BLOCK_PAYLOAD > \
+      MM_MAX_PAGE_ALLOCATABLE_MEMORY))
+
 #define MAX_FAMILIES_PER_VM_PAGE \
     ((SYSTEM_PAGE_SIZE - sizeof(vm_page_for_families_t *)) / sizeof(vm_page_family_t))
 
@@ -104,6 +534,7 @@ extern size_t SYSTEM_PAGE_SIZE;
         } \
     } while (0)
 
+#ifndef MM_COMPACT_HEADERS
 /* bind a free block after an allocated block */
 #define mm_bind_block_for_allocation(allocated_meta_block, free_meta_block) \
     do { \
@@ -114,29 +545,204 @@ extern size_t SYSTEM_PAGE_SIZE;
             (free_meta_block)->next_block->prev_block = (free_meta_block); \
         } \
     } while (0)
+#endif
 
 /* function prototypes */
 void mm_init(void);
-void mm_instantiate_new_page_family(const char *struct_name, uint32_t struct_size);
+int mm_init_with_page_size(size_t page_size, mm_page_backing_t backing);
+mm_family_handle_t mm_instantiate_new_page_family(const char *struct_name, uint32_t struct_size);
 vm_page_family_t *lookup_page_family_by_name(const char *struct_name);
+int mm_set_page_family_refill(const char *struct_name, uint32_t pages);
+int mm_set_page_family_policy(const char *struct_name, mm_alloc_policy_t policy);
 void *xcalloc(const char *struct_name, uint32_t units);
+void *xcalloc_h(mm_family_handle_t family, uint32_t units);
+void *xmalloc(const char *struct_name, uint32_t units);
+void *xmalloc_h(mm_family_handle_t family, uint32_t units);
+uint32_t xcalloc_bulk(mm_family_handle_t family, uint32_t units, uint32_t n, void **out);
+void xfree_bulk(void **ptrs, uint32_t n);
 void mm_free_block(vm_page_family_t *family, block_meta_data_t *block);
 void dump_lmm_state(void);
-block_meta_data_t *mm_allocate_free_data_block(vm_page_family_t *family, uint32_t req_size);
+block_meta_data_t *mm_allocate_free_data_block(vm_page_family_t *family, uint32_t req_size, uint32_t *dirty_bytes);
 void mm_split_free_data_blocks_for_allocation(vm_page_family_t *family, block_meta_data_t *block, uint32_t req_size);
 void mm_insert_free_block(vm_page_family_t *family, block_meta_data_t *block);
+block_meta_data_t *mm_split_block(block_meta_data_t *block, uint32_t req_size);
+void mm_union_free_blocks(block_meta_data_t *first, block_meta_data_t *second);
+void mm_absorb_next_block(block_meta_data_t *block, block_meta_data_t *next);
 /* heap helper functions */
 void mm_heapify_up(vm_page_family_t *family, int index);
 void mm_heapify_down(vm_page_family_t *family, int index);
 void mm_insert_free_block(vm_page_family_t *family, block_meta_data_t *block);
 block_meta_data_t *mm_extract_largest_block(vm_page_family_t *family);
-block_meta_data_t *mm_allocate_free_data_block(vm_page_family_t *family, uint32_t req_size);
+block_meta_data_t *mm_allocate_free_data_block(vm_page_family_t *family, uint32_t req_size, uint32_t *dirty_bytes);
 void mm_split_free_data_blocks_for_allocation(vm_page_family_t *family, block_meta_data_t *block, uint32_t req_size);
 
 bool mm_is_vm_page_empty(vm_page_t *vm_page);
 void mm_vm_page_delete_and_free(vm_page_t *vm_page);
 int mm_remove_block_from_heap(vm_page_family_t *family, block_meta_data_t *block);
 
+/* empty page caches */
+int mm_set_page_family_empty_cache(const char *struct_name, uint32_t low, uint32_t high);
+int mm_set_global_empty_cache(uint32_t low, uint32_t high);
+void *mm_page_cache_take(vm_page_family_t *family, bool *zeroed);
+void mm_page_cache_put(vm_page_family_t *family, void *vm_page);
+void mm_page_cache_trim(void);
+
+/* slab mode */
+int mm_set_page_family_slab(const char *struct_name);
+mm_family_handle_t mm_instantiate_new_slab_family(const char *struct_name, uint32_t struct_size);
+void *mm_slab_alloc(vm_page_family_t *family, bool *dirty);
+void mm_slab_free(mm_slab_t *slab, void *ptr);
+bool mm_slab_slot_is_free(mm_slab_t *slab, void *ptr);
+bool mm_slab_aligned(vm_page_family_t *family, uint32_t alignment);
+
+/* large-object regions */
+uint32_t mm_large_threshold(vm_page_family_t *family);
+int mm_set_page_family_large_threshold(const char *struct_name, uint32_t bytes);
+void *mm_large_alloc(vm_page_family_t *family, uint32_t units, uint32_t alignment);
+void mm_large_free(mm_large_region_t *region, void *ptr);
+
+/* size-class free lists */
+void mm_size_class_insert(vm_page_family_t *family, block_meta_data_t *block);
+int mm_size_class_remove(vm_page_family_t *family, block_meta_data_t *block);
+block_meta_data_t *mm_size_class_take(vm_page_family_t *family, uint32_t req_size);
+
+/* policy-independent free index used by the allocate/free paths */
+void mm_free_index_insert(vm_page_family_t *family, block_meta_data_t *block);
+int mm_free_index_remove(vm_page_family_t *family, block_meta_data_t *block);
+block_meta_data_t *mm_free_index_take(vm_page_family_t *family, uint32_t req_size);
+
 void xfree(void *ptr);
+/* ptr must be a live allocation; xrealloc(NULL, n) reports an error and
+ * returns NULL, since only ptr names the family */
+void *xrealloc(void *ptr, uint32_t units);
+
+/* locked family operations shared by xcalloc/xfree and the thread cache */
+void *mm_family_alloc_locked(vm_page_family_t *family, uint32_t units, uint32_t alignment,
+                             uint32_t *dirty_bytes);
+void mm_family_free_locked(vm_page_family_t *family, void *ptr);
+vm_page_family_t *mm_family_of(void *ptr);
+uint32_t mm_usable_size(void *ptr);
+
+/* mm_set_quiet(true) silences the out-of-memory messages on stdout; the
+ * allocating call still returns NULL. The malloc interposer sets it, since
+ * stdout belongs to the program it serves. */
+void mm_set_quiet(bool quiet);
+void mm_report_oom(vm_page_family_t *family);
+
+/* aligned allocation */
+int mm_set_page_family_alignment(const char *struct_name, uint32_t alignment);
+mm_family_handle_t mm_instantiate_new_aligned_family(const char *struct_name, uint32_t struct_size,
+                                                     uint32_t alignment);
+void *xcalloc_aligned(mm_family_handle_t family, uint32_t units, uint32_t alignment);
+block_meta_data_t *mm_allocate_aligned_data_block(vm_page_family_t *family, uint32_t req_size,
+                                                  uint32_t alignment, uint32_t *dirty_bytes);
+block_meta_data_t *mm_claim_free_block(vm_page_family_t *family, block_meta_data_t *block,
+                                       uint32_t req_size, uint32_t *dirty_bytes);
+
+/* statistics */
+int mm_get_stats(mm_family_handle_t family, mm_stats_t *out);
+void mm_get_global_stats(mm_stats_t *out);
+void mm_stats_note_alloc(vm_page_family_t *family, uint32_t requested, uint32_t granted);
+void mm_stats_note_free(vm_page_family_t *family, uint32_t granted);
+void mm_stats_note_resize(vm_page_family_t *family, uint32_t old_granted, uint32_t requested,
+                          uint32_t granted);
+void mm_stats_note_kernel(bool map, uint32_t pages);
+
+/* allocation tracing */
+extern bool mm_trace_active;
+int mm_trace_start(const char *path);
+void mm_trace_stop(void);
+void mm_trace_record(mm_trace_op_t op, vm_page_family_t *family, uint32_t size, bool zero, void *ptr);
+
+#define MM_TRACE_EVENT(op, family, size, zero, ptr) \
+    do { \
+        if (__builtin_expect(__atomic_load_n(&mm_trace_active, __ATOMIC_RELAXED), 0)) \
+            mm_trace_record(op, family, size, zero, ptr); \
+    } while (0)
+
+/* sampling heap profiler */
+typedef enum {
+    MM_PROFILE_FOLDED,  /* "family;caller;...;callee bytes" lines for flame graphs */
+    MM_PROFILE_PPROF    /* legacy text heap profile (heap_v2) that pprof reads */
+} mm_profile_format_t;
+
+extern bool mm_profile_active;
+extern __thread int64_t mm_profile_bytes_left; /* this thread's bytes to the next sample */
+int mm_profile_start(uint64_t sample_interval);
+void mm_profile_stop(void);
+int mm_profile_dump_fd(int fd, mm_profile_format_t format);
+void mm_profile_note_alloc(vm_page_family_t *family, uint32_t size, void *ptr);
+void mm_profile_note_free(vm_page_family_t *family, void *ptr);
+
+#define MM_PROFILE_ALLOC(family, size, ptr) \
+    do { \
+        if (__builtin_expect(__atomic_load_n(&mm_profile_active, __ATOMIC_RELAXED), 0) && \
+            (mm_profile_bytes_left -= (size)) <= 0) \
+            mm_profile_note_alloc(family, size, ptr); \
+    } while (0)
+
+#define MM_PROFILE_FREE(family, ptr) \
+    do { \
+        if (__builtin_expect(__atomic_load_n(&mm_profile_active, __ATOMIC_RELAXED), 0)) \
+            mm_profile_note_free(family, ptr); \
+    } while (0)
+
+/* NUMA placement */
+int mm_set_page_family_numa(const char *struct_name);
+vm_page_family_t *mm_instantiate_node_family(vm_page_family_t *parent, int node);
+vm_page_family_t *mm_numa_family_for_caller(vm_page_family_t *family);
+void mm_numa_note_free(vm_page_family_t *family);
+void mm_numa_bind(vm_page_family_t *family, void *region, size_t bytes);
+void mm_numa_note_page(vm_page_family_t *family, void *page);
+void mm_numa_note_alloc(vm_page_family_t *family, void *ptr);
+#ifdef MM_NUMA_FAKE_NODES
+void mm_numa_fake_set_node(uint32_t node);
+#endif
+
+/* scoped arenas */
+mm_arena_t *mm_arena_create(void);
+void *mm_arena_alloc(mm_arena_t *arena, uint32_t units);
+void *mm_arena_alloc_aligned(mm_arena_t *arena, uint32_t units, uint32_t alignment);
+void mm_arena_reset(mm_arena_t *arena);
+void mm_arena_destroy(mm_arena_t *arena);
+
+/* address-to-page map */
+int mm_page_map_register(void *hdr, uint32_t units);
+void mm_page_map_unregister(void *hdr, uint32_t units);
+void *mm_page_map_lookup(const void *ptr);
+bool mm_owns(const void *ptr);
+/* Header for a user pointer. Block and slab data never starts a page; only
+ * a large region aligned to a page or more does, past its header page. */
+#define MM_GET_PAGE_HDR_FROM_USER_PTR(ptr) \
+    (MM_GET_PAGE_HDR_FROM_PTR(ptr) == (void *)(ptr) ? mm_page_map_lookup(ptr) : MM_GET_PAGE_HDR_FROM_PTR(ptr))
+
+/* heap snapshots; a NULL family covers every family */
+ssize_t mm_snapshot_to_fd(mm_family_handle_t family, int fd);
+size_t mm_snapshot_to_buffer(mm_family_handle_t family, void *buf, size_t len);
+
+/* frees deferred past a busy family lock. Queued blocks are freed by the
+ * next holder of the family lock, by the queuing thread when the lock is
+ * free again by then, by a thread cache flush and by mm_set_remote_free
+ * (false). A family that sees no further traffic keeps its queue, and
+ * those blocks count as in use, until mm_get_stats or a snapshot of the
+ * family reclaims it. */
+extern bool mm_remote_free_enabled;
+void mm_set_remote_free(bool enable);
+bool mm_family_lock_or_defer(vm_page_family_t *family, void *ptr);
+void mm_remote_free_drain(vm_page_family_t *family);
+void mm_remote_free_reclaim(vm_page_family_t *family);
+
+/* caller holds family->lock */
+#define MM_REMOTE_FREE_DRAIN(family) \
+    do { \
+        if (__builtin_expect(__atomic_load_n(&(family)->remote_frees, __ATOMIC_RELAXED) != NULL, 0)) \
+            mm_remote_free_drain(family); \
+    } while (0)
+
+/* per-thread caches of recently freed blocks */
+void mm_set_thread_cache(bool enable);
+void mm_thread_cache_flush(void);
+void *mm_thread_cache_alloc(vm_page_family_t *family, uint32_t units);
+bool mm_thread_cache_free(vm_page_family_t *family, void *ptr);
 
 #endif /* __MM__ */
@@ -0,0 +1,103 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+
+/* Aligned allocation.
+ * A family may carry a default alignment, and xcalloc_aligned can ask for
+ * a stricter one per call. A free block whose user data is misaligned gives
+ * up a leading fragment, big enough to stay a free block of its own, so the
+ * aligned block starts at a boundary and the fragment coalesces normally
+ * once its neighbour is freed. Aligned block sizes are rounded so that the
+ * header after them lands where the next block's user data is aligned too,
+ * which lets back-to-back allocations skip the fragment altogether.
+ * Requests whose alignment exceeds MM_MAX_ALIGNMENT, or whose padding
+ * would not fit a page, get a large region instead. */
+
+static inline bool mm_alignment_valid(uint32_t alignment) {
+    return alignment >= MM_MIN_ALIGNMENT && alignment <= MM_MAX_ALIGNMENT &&
+           (alignment & (alignment - 1)) == 0;
+}
+
+/* Only allowed before the family owns pages, so every block it ever
+ * hands out honours the default */
+int mm_set_page_family_alignment(const char *struct_name, uint32_t alignment) {
+    vm_page_family_t *family = lookup_page_family_by_name(struct_name);
+    if (!family || !mm_alignment_valid(alignment)) return -1;
+
+    pthread_mutex_lock(&family->lock);
+    int rc = (family->first_page || family->partial_slabs || family->full_slabs) ? -1 : 0;
+    if (rc == 0) {
+        family->alignment = alignment;
+        if (family->slab_slot_size)
+            family->slab_slot_size = (family->slab_slot_size + alignment - 1) & ~(alignment - 1);
+    }
+    pthread_mutex_unlock(&family->lock);
+    return rc;
+}
+
+/* Register a family with a default alignment in one step */
+mm_family_handle_t mm_instantiate_new_aligned_family(const char *struct_name, uint32_t struct_size,
+                                                     uint32_t alignment) {
+    mm_family_handle_t family = mm_instantiate_new_page_family(struct_name, struct_size);
+    if (family && mm_set_page_family_alignment(struct_name, alignment) != 0)
+        fprintf(stderr, "Alignment %u unavailable for '%s'\n", alignment, struct_name);
+    return family;
+}
+
+/* Bytes to give up at the front of block so its user data is aligned, or
+ * UINT32_MAX when req_size no longer fits behind them */
+static uint32_t mm_aligned_lead(block_meta_data_t *block, uint32_t req_size, uint32_t alignment) {
+    uint32_t lead = (uint32_t)(-(uintptr_t)(block + 1) & (alignment - 1));
+    if (lead) {
+        /* the fragment keeps the old header and needs a minimal payload */
+        while (lead < sizeof(block_meta_data_t) + MM_MIN_BLOCK_PAYLOAD)
+            lead += alignment;
+    }
+    return (uint64_t)lead + req_size <= MM_BLOCK_SIZE(block) ? lead : UINT32_MAX;
+}
+
+block_meta_data_t *mm_allocate_aligned_data_block(vm_page_family_t *family, uint32_t req_size,
+                                                  uint32_t alignment, uint32_t *dirty_bytes) {
+    /* round the split point so the following header keeps the next block aligned */
+    req_size = MM_ALIGN_REQ_SIZE(req_size);
+    req_size = ((req_size + (uint32_t)sizeof(block_meta_data_t) + alignment - 1) & ~(alignment - 1)) -
+               (uint32_t)sizeof(block_meta_data_t);
+    if (req_size > MM_MAX_PAGE_ALLOCATABLE_MEMORY)
+        return NULL;
+
+    /* enough room for any lead in front of the block */
+    uint32_t worst = req_size + alignment + (uint32_t)sizeof(block_meta_data_t) + MM_MIN_BLOCK_PAYLOAD;
+
+    /* a fitting block that is already aligned needs no fragment; otherwise
+     * fall back to one big enough for the worst-case lead */
+    if (worst > MM_MAX_PAGE_ALLOCATABLE_MEMORY)
+        worst = req_size; /* only an already aligned block can work */
+    block_meta_data_t *block = mm_free_index_take(family, req_size);
+    if (block && mm_aligned_lead(block, req_size, alignment) == UINT32_MAX) {
+        mm_free_index_insert(family, block);
+        block = worst > req_size ? mm_free_index_take(family, worst) : NULL;
+    }
+    if (!block) {
+        if (!mm_family_add_vm_pages(family))
+            return NULL;
+        block = mm_free_index_take(family, worst);
+        if (!block)
+            return NULL;
+    }
+
+    uint32_t lead = mm_aligned_lead(block, req_size, alignment);
+    if (lead == UINT32_MAX) {
+        /* even a fresh page cannot place it */
+        mm_free_index_insert(family, block);
+        return NULL;
+    }
+    if (lead) {
+        /* the front stays free under the old header; re-marking it moves
+         * its footer to the new end */
+        block_meta_data_t *aligned = mm_split_block(block, lead - (uint32_t)sizeof(block_meta_data_t));
+        MM_BLOCK_SET_FREE(block);
+        mm_free_index_insert(family, block);
+        block = aligned;
+    }
+    return mm_claim_free_block(family, block, req_size, dirty_bytes);
+}
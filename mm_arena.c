@@ -0,0 +1,169 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Scoped arenas.
+ * An arena bump-allocates zeroed objects out of VM pages and gives them all
+ * back at once: mm_arena_reset recycles its pages for the next round,
+ * mm_arena_destroy unmaps them. Objects have no header and are never freed
+ * one by one (xfree rejects them). The arena structure itself sits in its
+ * first page, so an arena costs no memory outside the pages it holds.
+ * Objects too big for one page get a dedicated multi-page chunk, laid out
+ * like a large region so the chunk header is still one mask away.
+ * An arena has no lock: use it from one thread at a time. */
+
+#define MM_ARENA_CHUNK_CAPACITY \
+    ((uint32_t)(SYSTEM_PAGE_SIZE - sizeof(mm_arena_chunk_t)))
+/* first chunk bytes taken by the arena itself */
+#define MM_ARENA_SELF_BYTES ((uint32_t)((sizeof(mm_arena_t) + 15u) & ~15u))
+
+static mm_arena_chunk_t *mm_arena_chunk_new(mm_arena_t *arena, uint32_t units) {
+    mm_arena_chunk_t *chunk = (mm_arena_chunk_t *)mm_get_new_vm_page_from_kernel((int)units);
+    if (!chunk) return NULL;
+    if (mm_page_map_register(chunk, units) != 0) {
+        mm_return_vm_page_to_kernel(chunk, (int)units);
+        return NULL;
+    }
+    chunk->page_kind = MM_PAGE_ARENA;
+    chunk->units = units;
+    chunk->used = 0;
+    chunk->dirty = 0;
+    chunk->next = NULL;
+    chunk->arena = arena;
+    if (arena)
+        arena->pages += units;
+    return chunk;
+}
+
+static void mm_arena_chunks_release(mm_arena_chunk_t *chunk) {
+    while (chunk) {
+        mm_arena_chunk_t *next = chunk->next;
+        mm_return_vm_page_to_kernel(chunk, (int)chunk->units);
+        chunk = next;
+    }
+}
+
+mm_arena_t *mm_arena_create(void) {
+    mm_arena_chunk_t *chunk = mm_arena_chunk_new(NULL, 1);
+    if (!chunk) return NULL;
+
+    /* the arena occupies the head of its first chunk, which it never gives up */
+    mm_arena_t *arena = (mm_arena_t *)chunk->data;
+    memset(arena, 0, sizeof(*arena));
+    arena->current = chunk;
+    arena->pages = 1;
+    chunk->arena = arena;
+    chunk->used = chunk->dirty = MM_ARENA_SELF_BYTES;
+    return arena;
+}
+
+/* Zero the part of [start, start + units) that earlier rounds wrote */
+static inline void *mm_arena_claim(mm_arena_chunk_t *chunk, uint32_t start, uint32_t units) {
+    uint32_t end = start + units;
+    if (start < chunk->dirty)
+        memset(chunk->data + start, 0, (end < chunk->dirty ? end : chunk->dirty) - start);
+    if (end > chunk->dirty)
+        chunk->dirty = end;
+    chunk->used = end;
+    return chunk->data + start;
+}
+
+/* Offset in chunk->data at or after used where alignment holds for the address */
+static inline uint32_t mm_arena_align(mm_arena_chunk_t *chunk, uint32_t used, uint32_t alignment) {
+    uintptr_t addr = (uintptr_t)chunk->data + used;
+    return (uint32_t)(((addr + alignment - 1) & ~((uintptr_t)alignment - 1)) - (uintptr_t)chunk->data);
+}
+
+/* Objects that do not fit a single-page chunk */
+static void *mm_arena_alloc_oversized(mm_arena_t *arena, uint32_t units, uint32_t alignment) {
+    size_t pad = alignment > 16 ? alignment - 16 : 0;
+    size_t bytes = sizeof(mm_arena_chunk_t) + pad + (size_t)units;
+    mm_arena_chunk_t *chunk = mm_arena_chunk_new(arena, (uint32_t)((bytes + SYSTEM_PAGE_SIZE - 1) / SYSTEM_PAGE_SIZE));
+    if (!chunk) return NULL;
+    chunk->next = arena->oversized;
+    arena->oversized = chunk;
+    arena->bytes_allocated += units;
+    return mm_arena_claim(chunk, mm_arena_align(chunk, 0, alignment), units);
+}
+
+void *mm_arena_alloc_aligned(mm_arena_t *arena, uint32_t units, uint32_t alignment) {
+    if (!arena || !units) return NULL;
+    if (alignment < MM_MIN_ALIGNMENT || alignment > MM_MAX_ALIGNMENT || (alignment & (alignment - 1)))
+        return NULL;
+
+    mm_arena_chunk_t *chunk = arena->current;
+    uint32_t start = mm_arena_align(chunk, chunk->used, alignment);
+    if (start + (uint64_t)units <= MM_ARENA_CHUNK_CAPACITY) {
+        arena->bytes_allocated += units;
+        return mm_arena_claim(chunk, start, units);
+    }
+
+    /* every chunk has the same layout, so a fresh page pads the same way */
+    start = mm_arena_align(chunk, 0, alignment);
+    if (start + (uint64_t)units > MM_ARENA_CHUNK_CAPACITY)
+        return mm_arena_alloc_oversized(arena, units, alignment);
+
+    /* retire the current page; a recycled spare is reused before mapping */
+    mm_arena_chunk_t *next = arena->spare;
+    if (next) {
+        arena->spare = next->next;
+        next->next = NULL;
+    } else {
+        next = mm_arena_chunk_new(arena, 1);
+        if (!next) return NULL;
+    }
+    chunk->next = arena->full;
+    arena->full = chunk;
+    arena->current = next;
+
+    arena->bytes_allocated += units;
+    return mm_arena_claim(next, start, units);
+}
+
+void *mm_arena_alloc(mm_arena_t *arena, uint32_t units) {
+    return mm_arena_alloc_aligned(arena, units, MM_MIN_ALIGNMENT);
+}
+
+/* Drop every object at once. Single pages are kept for the next round;
+ * oversized chunks go back to the kernel. O(pages), no per-object work. */
+void mm_arena_reset(mm_arena_t *arena) {
+    if (!arena) return;
+
+    mm_arena_chunk_t *first = MM_GET_PAGE_HDR_FROM_PTR(arena);
+    for (mm_arena_chunk_t *chunk = arena->oversized; chunk; chunk = chunk->next)
+        arena->pages -= chunk->units;
+    mm_arena_chunks_release(arena->oversized);
+    arena->oversized = NULL;
+
+    /* every single page but the first becomes a spare */
+    mm_arena_chunk_t *chunk = arena->full;
+    while (chunk) {
+        mm_arena_chunk_t *next = chunk->next;
+        if (chunk != first) {
+            chunk->used = 0;
+            chunk->next = arena->spare;
+            arena->spare = chunk;
+        }
+        chunk = next;
+    }
+    if (arena->current != first) {
+        arena->current->used = 0;
+        arena->current->next = arena->spare;
+        arena->spare = arena->current;
+    }
+    arena->full = NULL;
+    arena->current = first;
+    first->next = NULL;
+    first->used = MM_ARENA_SELF_BYTES;
+    arena->bytes_allocated = 0;
+}
+
+void mm_arena_destroy(mm_arena_t *arena) {
+    if (!arena) return;
+
+    mm_arena_reset(arena);
+    mm_arena_chunks_release(arena->spare);
+    /* the arena lives in this page: unmap it last */
+    mm_return_vm_page_to_kernel(MM_GET_PAGE_HDR_FROM_PTR(arena), 1);
+}
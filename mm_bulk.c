@@ -0,0 +1,256 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+/* Batch allocation and release.
+ * xcalloc_bulk takes the family lock once and carves consecutive blocks out
+ * of each free block it takes, putting only the final remainder back into
+ * the free index. xfree_bulk sorts the pointers by address so each page is
+ * handled once: its blocks are marked free, one sweep over the page merges
+ * neighbouring free blocks, and the page-empty decision is made once. */
+
+/* Carve up to n blocks of req_size from the front of a free block */
+static uint32_t mm_bulk_carve(vm_page_family_t *family, block_meta_data_t *block,
+                              uint32_t req_size, uint32_t units, uint32_t n, void **out) {
+    vm_page_t *vm_page = (vm_page_t *)MM_GET_PAGE_FROM_META_BLOCK(block);
+    uint32_t done = 0;
+
+    /* the first block always fits; later remainders may not */
+    while (block && done < n && MM_BLOCK_SIZE(block) >= req_size) {
+        uint32_t user_offset = block->offset + sizeof(block_meta_data_t);
+        uint32_t dirty = vm_page->clean_offset > user_offset ?
+                         vm_page->clean_offset - user_offset : 0;
+
+        block_meta_data_t *rest = mm_split_block(block, req_size);
+        MM_VM_PAGE_MARK_ALLOCATED(vm_page, block);
+        MM_VM_PAGE_TOUCH(vm_page, user_offset + MM_BLOCK_SIZE(block));
+        mm_stats_note_alloc(family, units, MM_BLOCK_SIZE(block));
+        if (dirty)
+            memset(block + 1, 0, dirty < units ? dirty : units);
+
+        out[done++] = block + 1;
+        block = rest;
+    }
+    if (block)
+        mm_free_index_insert(family, block);
+    return done;
+}
+
+static uint32_t mm_xcalloc_bulk(mm_family_handle_t family, uint32_t units, uint32_t n, void **out) {
+    uint32_t done = 0;
+
+    if (units > mm_large_threshold(family) || MM_ALLOC_NEEDS_REGION(units, family->alignment)) {
+        for (; done < n; done++) {
+            out[done] = mm_large_alloc(family, units, family->alignment);
+            if (!out[done]) break;
+        }
+        return done;
+    }
+
+    pthread_mutex_lock(&family->lock);
+    MM_REMOTE_FREE_DRAIN(family);
+
+    if (family->slab_slot_size && units <= family->slab_slot_size &&
+        mm_slab_aligned(family, family->alignment)) {
+        for (; done < n; done++) {
+            bool dirty = true;
+            out[done] = mm_slab_alloc(family, &dirty);
+            if (!out[done]) break;
+            mm_stats_note_alloc(family, units, family->slab_slot_size);
+            if (dirty)
+                memset(out[done], 0, units);
+        }
+        pthread_mutex_unlock(&family->lock);
+        return done;
+    }
+
+    if (family->alignment > MM_MIN_ALIGNMENT) {
+        /* aligned families place every block individually */
+        for (; done < n; done++) {
+            uint32_t dirty = units;
+            out[done] = mm_family_alloc_locked(family, units, family->alignment, &dirty);
+            if (!out[done]) break;
+            if (dirty)
+                memset(out[done], 0, dirty < units ? dirty : units);
+        }
+        pthread_mutex_unlock(&family->lock);
+        if (done < n)
+            mm_report_oom(family);
+        return done;
+    }
+
+    uint32_t req_size = MM_ALIGN_REQ_SIZE(units);
+    if (req_size <= MM_MAX_PAGE_ALLOCATABLE_MEMORY) {
+        while (done < n) {
+            block_meta_data_t *block = mm_free_index_take(family, req_size);
+            if (!block) {
+                if (!mm_family_add_vm_pages(family))
+                    break;
+                block = mm_free_index_take(family, req_size);
+                if (!block)
+                    break;
+            }
+            done += mm_bulk_carve(family, block, req_size, units, n - done, out + done);
+        }
+    }
+
+    pthread_mutex_unlock(&family->lock);
+    if (done < n)
+        mm_report_oom(family);
+    return done;
+}
+
+/* Allocate n zeroed objects of units bytes; returns how many were allocated */
+uint32_t xcalloc_bulk(mm_family_handle_t family, uint32_t units, uint32_t n, void **out) {
+    if (family->numa_nodes)
+        family = mm_numa_family_for_caller(family);
+    uint32_t done = mm_xcalloc_bulk(family, units, n, out);
+    if (family->numa_node >= 0) {
+        for (uint32_t i = 0; i < done; i++)
+            mm_numa_note_alloc(family, out[i]);
+    }
+    if (__atomic_load_n(&mm_trace_active, __ATOMIC_RELAXED)) {
+        for (uint32_t i = 0; i < done; i++)
+            mm_trace_record(MM_TRACE_ALLOC, family, units, true, out[i]);
+    }
+    if (__atomic_load_n(&mm_profile_active, __ATOMIC_RELAXED)) {
+        for (uint32_t i = 0; i < done; i++)
+            MM_PROFILE_ALLOC(family, units, out[i]);
+    }
+    return done;
+}
+
+static int mm_bulk_ptr_cmp(const void *a, const void *b) {
+    uintptr_t pa = (uintptr_t)*(void *const *)a;
+    uintptr_t pb = (uintptr_t)*(void *const *)b;
+    return pa < pb ? -1 : pa > pb;
+}
+
+/* Release every block of ptrs[0..n) that lives on vm_page; caller holds
+ * the family lock */
+static void mm_bulk_free_page(vm_page_family_t *family, vm_page_t *vm_page,
+                              void **ptrs, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        block_meta_data_t *block = (block_meta_data_t *)ptrs[i] - 1;
+        /* the same block twice in one batch */
+        if (MM_BLOCK_IS_FREE(block)) {
+            fprintf(stderr, "xfree: %p was not allocated here or is already released\n", ptrs[i]);
+            continue;
+        }
+        mm_stats_note_free(family, MM_BLOCK_SIZE(block));
+        MM_VM_PAGE_MARK_FREE(vm_page, block);
+    }
+
+    /* one sweep merges every run of free neighbours on the page */
+    block_meta_data_t *block = &vm_page->block_meta_data;
+    while (block) {
+        block_meta_data_t *next = NEXT_META_BLOCK(block);
+        bool merging = MM_BLOCK_IS_FREE(block) && next && MM_BLOCK_IS_FREE(next);
+        bool newly_free = MM_BLOCK_IS_FREE(block) && MM_BLOCK_HEAP_INDEX(block) == MM_HEAP_INDEX_NONE;
+        if (merging || newly_free) {
+            mm_free_index_remove(family, block);
+            while (next && MM_BLOCK_IS_FREE(next)) {
+                mm_free_index_remove(family, next);
+                mm_union_free_blocks(block, next);
+                next = NEXT_META_BLOCK(block);
+            }
+            mm_free_index_insert(family, block);
+        }
+        block = next;
+    }
+
+    if (mm_is_vm_page_empty(vm_page)) {
+        mm_free_index_remove(family, &vm_page->block_meta_data);
+        mm_vm_page_delete_and_free(vm_page);
+    }
+}
+
+/* Family recorded in a page, slab or large region header */
+static vm_page_family_t *mm_bulk_page_family(void *page_hdr) {
+    switch (MM_PAGE_KIND(page_hdr)) {
+    case MM_PAGE_SLAB:
+        return ((mm_slab_t *)page_hdr)->pg_family;
+    case MM_PAGE_LARGE:
+        return ((mm_large_region_t *)page_hdr)->pg_family;
+    default:
+        return ((vm_page_t *)page_hdr)->pg_family;
+    }
+}
+
+/* Free n pointers at once. The ptrs array is reordered (sorted by address)
+ * and pointers that are not live allocations are replaced by NULL. */
+void xfree_bulk(void **ptrs, uint32_t n) {
+    /* validate and account each pointer once; the headers then name the family */
+    bool tracing = __atomic_load_n(&mm_trace_active, __ATOMIC_RELAXED);
+    bool profiling = __atomic_load_n(&mm_profile_active, __ATOMIC_RELAXED);
+    for (uint32_t i = 0; i < n; i++) {
+        vm_page_family_t *family = ptrs[i] ? mm_family_of(ptrs[i]) : NULL;
+        if (!family) {
+            ptrs[i] = NULL;
+            continue;
+        }
+        if (tracing)
+            mm_trace_record(MM_TRACE_FREE, family, 0, false, ptrs[i]);
+        if (profiling)
+            mm_profile_note_free(family, ptrs[i]);
+        if (family->numa_node >= 0)
+            mm_numa_note_free(family);
+    }
+    if (n)
+        qsort(ptrs, n, sizeof(void *), mm_bulk_ptr_cmp);
+
+    vm_page_family_t *locked = NULL;
+    uint32_t i = 0;
+    while (i < n) {
+        void *ptr = ptrs[i];
+        if (!ptr) {
+            i++;
+            continue;
+        }
+
+        void *page_hdr = MM_GET_PAGE_HDR_FROM_USER_PTR(ptr);
+        vm_page_family_t *family = mm_bulk_page_family(page_hdr);
+        if (MM_PAGE_KIND(page_hdr) == MM_PAGE_LARGE) {
+            if (locked) {
+                pthread_mutex_unlock(&locked->lock);
+                locked = NULL;
+            }
+            mm_large_free((mm_large_region_t *)page_hdr, ptr);
+            i++;
+            continue;
+        }
+
+        /* sorted input: consecutive pointers of one family share the lock */
+        if (locked != family) {
+            if (locked)
+                pthread_mutex_unlock(&locked->lock);
+            pthread_mutex_lock(&family->lock);
+            MM_REMOTE_FREE_DRAIN(family);
+            locked = family;
+        }
+
+        /* gather the run of pointers on this page */
+        uint32_t j = i + 1;
+        while (j < n && MM_GET_PAGE_HDR_FROM_PTR(ptrs[j]) == page_hdr)
+            j++;
+
+        if (MM_PAGE_KIND(page_hdr) == MM_PAGE_SLAB) {
+            for (uint32_t k = i; k < j; k++) {
+                /* the same slot twice in one batch */
+                if (mm_slab_slot_is_free((mm_slab_t *)page_hdr, ptrs[k])) {
+                    fprintf(stderr, "xfree: %p was not allocated here or is already released\n", ptrs[k]);
+                    continue;
+                }
+                mm_stats_note_free(family, family->slab_slot_size);
+                mm_slab_free((mm_slab_t *)page_hdr, ptrs[k]);
+            }
+        } else {
+            mm_bulk_free_page(family, (vm_page_t *)page_hdr, ptrs + i, j - i);
+        }
+        i = j;
+    }
+    if (locked)
+        pthread_mutex_unlock(&locked->lock);
+}
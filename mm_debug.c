@@ -5,16 +5,26 @@
 #include <assert.h>
 
 void print_block(block_meta_data_t *block) {
+#ifdef MM_COMPACT_HEADERS
+    printf("    Block [%p] - size: %u, is_free: %s, prev free: %p, next: %p\n",
+           (void *)block,
+           MM_BLOCK_SIZE(block),
+           MM_BLOCK_IS_FREE(block) ? "TRUE" : "FALSE",
+           (void *)PREV_FREE_META_BLOCK(block),
+           (void *)NEXT_META_BLOCK(block));
+#else
     printf("    Block [%p] - size: %u, is_free: %s, prev: %p, next: %p\n",
            (void *)block,
            block->block_size,
            block->is_free ? "TRUE" : "FALSE",
            (void *)block->prev_block,
            (void *)NEXT_META_BLOCK(block));
+#endif
 }
 
 void print_vm_page(vm_page_t *page) {
-    printf("  VM Page [%p] - Family: %s\n", (void *)page, page->pg_family->struct_name);
+    printf("  VM Page [%p] - Family: %s, live blocks: %u, free bytes: %u\n", (void *)page,
+           page->pg_family->struct_name, page->live_blocks, page->free_bytes);
     block_meta_data_t *curr = &page->block_meta_data;
 
     while (curr) {
@@ -37,6 +47,8 @@ void dump_lmm_state() {
                    family->struct_name,
                    family->struct_size,
                    (void *)family->first_page);
+            if (family->numa_node >= 0)
+                printf("  NUMA pool for node %d\n", family->numa_node);
 
             vm_page_t *page = family->first_page;
             int page_idx = 0;
@@ -46,10 +58,36 @@ void dump_lmm_state() {
                 page = page->next;
             }
 
+            for (int full = 0; full < 2; full++) {
+                mm_slab_t *slab = full ? family->full_slabs : family->partial_slabs;
+                for (; slab; slab = slab->next) {
+                    printf("  Slab [%p] - slot size: %u, slots: %u, free: %u\n",
+                           (void *)slab, family->slab_slot_size,
+                           slab->slot_count, slab->free_count);
+                }
+            }
+
+            for (mm_large_region_t *region = family->large_regions; region; region = region->next) {
+                printf("  Large Region [%p] - size: %u, pages: %u\n",
+                       (void *)region, region->user_size, region->units);
+            }
+
             if (family->heap_size > 0) {
                 printf("  Free Block Heap: ");
                 for (uint32_t i = 0; i < family->heap_size; i++) {
-                    printf("[%u bytes] ", family->free_block_heap[i]->block_size);
+                    printf("[%u bytes] ", MM_BLOCK_SIZE(family->free_block_heap[i]));
+                }
+                printf("\n");
+            }
+
+            if (MM_POLICY_HAS_SIZE_CLASSES(family->policy) && family->size_class_bitmap) {
+                printf("  Free Size Classes: ");
+                for (uint32_t c = 0; c < MM_SIZE_CLASSES; c++) {
+                    uint32_t count = 0;
+                    for (block_meta_data_t *b = family->size_class_head[c]; b; b = MM_FREE_LINK(b)->next)
+                        count++;
+                    if (count)
+                        printf("[%u+ bytes x%u] ", 1u << c, count);
                 }
                 printf("\n");
             }
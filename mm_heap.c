@@ -8,7 +8,7 @@ static inline int left(int i) { return 2 * i + 1; }
 static inline int right(int i) { return 2 * i + 2; }
 
 /*void mm_heapify_up(vm_page_family_t *family, int index) {
-    while (index > 0 && family->free_block_heap[parent(index)]->block_size < family->free_block_heap[index]->block_size) {
+    while (index > 0 && MM_BLOCK_SIZE(family->free_block_heap[parent(index)]) < MM_BLOCK_SIZE(family->free_block_heap[index])) {
         block_meta_data_t *tmp = family->free_block_heap[parent(index)];
         family->free_block_heap[parent(index)] = family->free_block_heap[index];
         family->free_block_heap[index] = tmp;
@@ -19,9 +19,9 @@ static inline int right(int i) { return 2 * i + 2; }
 void mm_heapify_down(vm_page_family_t *family, int index) {
     int largest = index;
     int l = left(index), r = right(index);
-    if (l < family->heap_size && family->free_block_heap[l]->block_size > family->free_block_heap[largest]->block_size)
+    if (l < family->heap_size && MM_BLOCK_SIZE(family->free_block_heap[l]) > MM_BLOCK_SIZE(family->free_block_heap[largest]))
         largest = l;
-    if (r < family->heap_size && family->free_block_heap[r]->block_size > family->free_block_heap[largest]->block_size)
+    if (r < family->heap_size && MM_BLOCK_SIZE(family->free_block_heap[r]) > MM_BLOCK_SIZE(family->free_block_heap[largest]))
         largest = r;
     if (largest != index) {
         block_meta_data_t *tmp = family->free_block_heap[index];
@@ -45,47 +45,221 @@ block_meta_data_t *mm_extract_largest_block(vm_page_family_t *family) {
     if (!family->heap_size) return NULL;
     block_meta_data_t *max = family->free_block_heap[0];
     family->free_block_heap[0] = family->free_block_heap[family->heap_size - 1];
+    MM_BLOCK_HEAP_INDEX(family->free_block_heap[0]) = 0;
     family->heap_size--;
+    MM_BLOCK_HEAP_INDEX(max) = MM_HEAP_INDEX_NONE;
     mm_heapify_down(family, 0);
     return max;
 }
 
+/* Dispatch to the family's free index: max-heap or size-class lists
+ * (MM_POLICY_SIZE_CLASS and MM_POLICY_DENSE) */
+void mm_free_index_insert(vm_page_family_t *family, block_meta_data_t *block) {
+    if (MM_POLICY_HAS_SIZE_CLASSES(family->policy))
+        mm_size_class_insert(family, block);
+    else
+        mm_insert_free_block(family, block);
+    MM_STAT_ADD(family, free_blocks, 1);
+}
+
+int mm_free_index_remove(vm_page_family_t *family, block_meta_data_t *block) {
+    int removed = MM_POLICY_HAS_SIZE_CLASSES(family->policy) ?
+                  mm_size_class_remove(family, block) :
+                  mm_remove_block_from_heap(family, block);
+    if (removed)
+        MM_STAT_SUB(family, free_blocks, 1);
+    return removed;
+}
+
+block_meta_data_t *mm_free_index_take(vm_page_family_t *family, uint32_t req_size) {
+    block_meta_data_t *block;
+    if (MM_POLICY_HAS_SIZE_CLASSES(family->policy)) {
+        block = mm_size_class_take(family, req_size);
+    } else {
+        block = mm_extract_largest_block(family);
+        if (block && MM_BLOCK_SIZE(block) < req_size) {
+            mm_insert_free_block(family, block); // keep it for smaller requests
+            block = NULL;
+        }
+    }
+    if (block)
+        MM_STAT_SUB(family, free_blocks, 1);
+    return block;
+}
+
+/* Cut block down to req_size bytes and return the free remainder, which is
+ * not yet in the free index; NULL when the remainder could not hold a header
+ * plus a minimal free block */
+block_meta_data_t *mm_split_block(block_meta_data_t *block, uint32_t req_size) {
+    if (MM_BLOCK_SIZE(block) < req_size + sizeof(block_meta_data_t) + MM_MIN_BLOCK_PAYLOAD)
+        return NULL;
+
+    vm_page_t *vm_page = (vm_page_t *)MM_GET_PAGE_FROM_META_BLOCK(block);
+    block_meta_data_t *new_free = (block_meta_data_t *)((char *)(block + 1) + req_size);
+    uint32_t new_size = MM_BLOCK_SIZE(block) - req_size - (uint32_t)sizeof(block_meta_data_t);
+    new_free->offset = block->offset + sizeof(block_meta_data_t) + req_size;
+#ifdef MM_COMPACT_HEADERS
+    new_free->size_flags = new_size | (MM_BLOCK_IS_FREE(block) ? MM_BLOCK_PREV_FREE : 0);
+    MM_BLOCK_SET_SIZE(block, req_size);
+    MM_BLOCK_SET_FREE(new_free);
+#else
+    new_free->block_size = new_size;
+    new_free->is_free = MM_TRUE;
+    new_free->prev_block = block;
+    new_free->next_block = block->next_block;
+    if (block->next_block) block->next_block->prev_block = new_free;
+    block->next_block = new_free;
+    block->block_size = req_size;
+#endif
+    MM_BLOCK_HEAP_INDEX(new_free) = MM_HEAP_INDEX_NONE;
+    /* splitting a free block spends a header; trimming a live one frees the tail */
+    if (MM_BLOCK_IS_FREE(block))
+        vm_page->free_bytes -= sizeof(block_meta_data_t);
+    else
+        vm_page->free_bytes += new_size;
+    MM_STAT_ADD(vm_page->pg_family, splits, 1);
+    MM_VM_PAGE_TOUCH(vm_page, new_free->offset + sizeof(block_meta_data_t) + MM_FREE_BLOCK_META_BYTES);
+    return new_free;
+}
+
 void mm_split_free_data_blocks_for_allocation(vm_page_family_t *family, block_meta_data_t *block, uint32_t req_size) {
-    if (block->block_size > req_size + sizeof(block_meta_data_t)) {
-        block_meta_data_t *new_free = (block_meta_data_t *)((char *)(block + 1) + req_size);
-        new_free->block_size = block->block_size - req_size - sizeof(block_meta_data_t);
-        new_free->is_free = MM_TRUE;
-        new_free->prev_block = block;
-        new_free->next_block = block->next_block;
-        if (block->next_block) block->next_block->prev_block = new_free;
-        block->next_block = new_free;
-        block->block_size = req_size;
-        mm_insert_free_block(family, new_free);
+    block_meta_data_t *new_free = mm_split_block(block, req_size);
+    if (new_free)
+        mm_free_index_insert(family, new_free);
+}
+
+/* dirty_bytes (optional) receives how many leading bytes of the user area
+ * may hold stale data; everything after them is known to be zero */
+block_meta_data_t *mm_allocate_free_data_block(vm_page_family_t *family, uint32_t req_size,
+                                               uint32_t *dirty_bytes) {
+    // Keep blocks 8-byte aligned and large enough to hold free-list links
+    req_size = MM_ALIGN_REQ_SIZE(req_size);
+
+    // A request larger than an empty page can never be satisfied
+    if (req_size > MM_MAX_PAGE_ALLOCATABLE_MEMORY)
+        return NULL;
+
+    // Step 1: Take a fitting free block according to the family policy
+    block_meta_data_t *largest = mm_free_index_take(family, req_size);
+
+    // Step 2: Grow the family when no free block is big enough
+    if (!largest) {
+        if (!mm_family_add_vm_pages(family))
+            return NULL; // kernel refused more memory
+        largest = mm_free_index_take(family, req_size);
+        if (!largest)
+            return NULL;
+    }
+
+    return mm_claim_free_block(family, largest, req_size, dirty_bytes);
+}
+
+/* Turn a free block taken out of the free index into an allocation of
+ * req_size bytes, returning the tail to the index */
+block_meta_data_t *mm_claim_free_block(vm_page_family_t *family, block_meta_data_t *block,
+                                       uint32_t req_size, uint32_t *dirty_bytes) {
+    // Note how much of the user area was ever written, before the split
+    // header and the user data move the page's clean watermark
+    vm_page_t *vm_page = (vm_page_t *)MM_GET_PAGE_FROM_META_BLOCK(block);
+    uint32_t user_offset = block->offset + sizeof(block_meta_data_t);
+    if (dirty_bytes) {
+        *dirty_bytes = vm_page->clean_offset > user_offset ?
+                       vm_page->clean_offset - user_offset : 0;
     }
+
+    // Split block if needed
+    mm_split_free_data_blocks_for_allocation(family, block, req_size);
+
+    // Mark as allocated; the caller may write the whole block
+    MM_VM_PAGE_MARK_ALLOCATED(vm_page, block);
+    MM_VM_PAGE_TOUCH(vm_page, user_offset + MM_BLOCK_SIZE(block));
+
+    return block;
 }
 
-block_meta_data_t *mm_allocate_free_data_block(vm_page_family_t *family, uint32_t req_size) {
-    // If no page exists yet, allocate one
-    if (!family->first_page) {
-        allocate_vm_page(family);
-        // Insert the first block into free block heap
-        mm_insert_free_block(family, &family->first_page->block_meta_data);
+
+/* Allocate units bytes from a family; caller holds family->lock.
+ * *dirty_bytes receives how many leading bytes may hold stale data. */
+void *mm_family_alloc_locked(vm_page_family_t *family, uint32_t units, uint32_t alignment,
+                             uint32_t *dirty_bytes) {
+    /* Slab families serve single-struct requests from header-less slots */
+    if (family->slab_slot_size && units <= family->slab_slot_size &&
+        mm_slab_aligned(family, alignment)) {
+        bool dirty = true;
+        void *slot = mm_slab_alloc(family, &dirty);
+        *dirty_bytes = dirty ? units : 0;
+        if (slot)
+            mm_stats_note_alloc(family, units, family->slab_slot_size);
+        return slot;
     }
 
-    // Step 1: Extract the largest free block from heap
-    block_meta_data_t *largest = mm_extract_largest_block(family);
-    if (!largest || largest->block_size < req_size)
-        return NULL; // Not enough memory
+    block_meta_data_t *block = alignment > MM_MIN_ALIGNMENT ?
+        mm_allocate_aligned_data_block(family, units, alignment, dirty_bytes) :
+        mm_allocate_free_data_block(family, units, dirty_bytes);
+    if (!block)
+        return NULL;
+    mm_stats_note_alloc(family, units, MM_BLOCK_SIZE(block));
+    return block + 1;
+}
 
-    // Step 2: Split block if needed
-    mm_split_free_data_blocks_for_allocation(family, largest, req_size);
+/* out-of-memory messages; see mm_set_quiet */
+static bool mm_quiet = false;
 
-    // Step 3: Mark as allocated
-    largest->is_free = MM_FALSE;
+void mm_set_quiet(bool quiet) {
+    __atomic_store_n(&mm_quiet, quiet, __ATOMIC_RELAXED);
+}
 
-    return largest;
+void mm_report_oom(vm_page_family_t *family) {
+    if (!__atomic_load_n(&mm_quiet, __ATOMIC_RELAXED))
+        printf("ERROR: Not enough memory in page family '%s'\n", family->struct_name);
 }
 
+/* Common allocation path; zero selects calloc or malloc semantics */
+static void *mm_alloc_h(mm_family_handle_t family, uint32_t units, uint32_t alignment, bool zero) {
+    if (family->numa_nodes)
+        family = mm_numa_family_for_caller(family);
+    if (alignment < family->alignment)
+        alignment = family->alignment;
+
+    /* Big requests get their own mapping, which the kernel hands out zeroed;
+     * so do aligned ones whose alignment padding would not fit a page */
+    if (units > mm_large_threshold(family) || MM_ALLOC_NEEDS_REGION(units, alignment)) {
+        void *region_data = mm_large_alloc(family, units, alignment);
+        if (!region_data) {
+            mm_report_oom(family);
+            return NULL;
+        }
+        if (family->numa_node >= 0)
+            mm_numa_note_alloc(family, region_data);
+        MM_TRACE_EVENT(MM_TRACE_ALLOC, family, units, zero, region_data);
+        MM_PROFILE_ALLOC(family, units, region_data);
+        return region_data;
+    }
+
+    /* Per-thread cache first: no lock on a hit. Cached blocks only carry
+     * the family's own alignment. */
+    uint32_t dirty_bytes = units;
+    void *user_ptr = alignment == family->alignment ? mm_thread_cache_alloc(family, units) : NULL;
+    if (!user_ptr) {
+        pthread_mutex_lock(&family->lock);
+        MM_REMOTE_FREE_DRAIN(family);
+        user_ptr = mm_family_alloc_locked(family, units, alignment, &dirty_bytes);
+        pthread_mutex_unlock(&family->lock);
+    }
+    if (!user_ptr) {
+        mm_report_oom(family);
+        return NULL;
+    }
+
+    /* Only clear what may hold stale data: fresh pages are already zero */
+    if (zero && dirty_bytes)
+        memset(user_ptr, 0, dirty_bytes < units ? dirty_bytes : units);
+    if (family->numa_node >= 0)
+        mm_numa_note_alloc(family, user_ptr);
+    MM_TRACE_EVENT(MM_TRACE_ALLOC, family, units, zero, user_ptr);
+    MM_PROFILE_ALLOC(family, units, user_ptr);
+    return user_ptr;
+}
 
 void *xcalloc(const char *struct_name, uint32_t units) {
     vm_page_family_t *family = lookup_page_family_by_name(struct_name);
@@ -93,54 +267,164 @@ void *xcalloc(const char *struct_name, uint32_t units) {
         printf("ERROR: Page family '%s' is not registered\n", struct_name);
         return NULL;
     }
+    return mm_alloc_h(family, units, MM_MIN_ALIGNMENT, true);
+}
+
+/* Allocate through a registration handle, skipping the name lookup */
+void *xcalloc_h(mm_family_handle_t family, uint32_t units) {
+    return mm_alloc_h(family, units, MM_MIN_ALIGNMENT, true);
+}
 
-    block_meta_data_t *block = mm_allocate_free_data_block(family, units);
-    if (!block) {
-        printf("ERROR: Not enough memory in page family '%s'\n", struct_name);
+/* Allocate zeroed memory whose address is a multiple of alignment, a power
+ * of two. Alignments above MM_MAX_ALIGNMENT take the large path. */
+void *xcalloc_aligned(mm_family_handle_t family, uint32_t units, uint32_t alignment) {
+    if (alignment & (alignment - 1)) {
+        printf("ERROR: Unsupported alignment %u\n", alignment);
         return NULL;
     }
+    return mm_alloc_h(family, units, alignment, true);
+}
 
-    void *user_ptr = (void *)(block + 1);
-    memset(user_ptr, 0, units);
-    return user_ptr;
+/* Like xcalloc, but the memory is not cleared: for callers that overwrite it */
+void *xmalloc(const char *struct_name, uint32_t units) {
+    vm_page_family_t *family = lookup_page_family_by_name(struct_name);
+    if (!family) {
+        printf("ERROR: Page family '%s' is not registered\n", struct_name);
+        return NULL;
+    }
+    return mm_alloc_h(family, units, MM_MIN_ALIGNMENT, false);
 }
-/* xfree — safe free wrapper used by user code */
-void xfree(void *ptr) {
-    if (!ptr) return;
 
-    /* compute block meta pointer */
-    block_meta_data_t *block = (block_meta_data_t *)ptr - 1;
+void *xmalloc_h(mm_family_handle_t family, uint32_t units) {
+    return mm_alloc_h(family, units, MM_MIN_ALIGNMENT, false);
+}
 
-    /* find vm_page from meta using macro in mm.h */
-    vm_page_t *vm_page = (vm_page_t *)MM_GET_PAGE_FROM_META_BLOCK(block);
-    if (!vm_page) {
-        fprintf(stderr, "xfree: invalid pointer (no vm_page) %p\n", ptr);
-        return;
+/* Find the family owning a user pointer. The page map says which page
+ * covers it, so nothing at the pointer is read before it is known to be
+ * ours; the header is then checked against the pointer. */
+vm_page_family_t *mm_family_of(void *ptr) {
+    void *page_hdr = mm_page_map_lookup(ptr);
+    if (!page_hdr) {
+        fprintf(stderr, "xfree: %p was not allocated here or is already released\n", ptr);
+        return NULL;
+    }
+    /* user data starts in the page holding its header, or on a page of its own */
+    if (page_hdr != MM_GET_PAGE_HDR_FROM_USER_PTR(ptr)) {
+        fprintf(stderr, "xfree: %p points inside a large allocation\n", ptr);
+        return NULL;
     }
 
-    vm_page_family_t *family = vm_page->pg_family;
-    if (!family) {
-        fprintf(stderr, "xfree: pointer does not belong to a family %p\n", ptr);
-        return;
+    switch (MM_PAGE_KIND(page_hdr)) {
+    case MM_PAGE_SLAB: {
+        /* slab slots carry no header: the offset must land on a slot */
+        mm_slab_t *slab = (mm_slab_t *)page_hdr;
+        size_t offset = (size_t)((char *)ptr - slab->slots);
+        if ((char *)ptr < slab->slots || offset % slab->pg_family->slab_slot_size ||
+            offset / slab->pg_family->slab_slot_size >= slab->slot_count) {
+            fprintf(stderr, "xfree: %p is not a slab slot\n", ptr);
+            return NULL;
+        }
+        if (mm_slab_slot_is_free(slab, ptr)) {
+            fprintf(stderr, "xfree: %p was not allocated here or is already released\n", ptr);
+            return NULL;
+        }
+        return slab->pg_family;
+    }
+    case MM_PAGE_LARGE: {
+        mm_large_region_t *region = (mm_large_region_t *)page_hdr;
+        if ((char *)ptr != (char *)region + region->user_offset) {
+            fprintf(stderr, "xfree: %p points inside a large allocation\n", ptr);
+            return NULL;
+        }
+        return region->pg_family;
+    }
+    case MM_PAGE_ARENA:
+        fprintf(stderr, "xfree: %p belongs to an arena, release it with mm_arena_reset\n", ptr);
+        return NULL;
+    default:
+        break;
+    }
+
+    /* the block header in front of the pointer must agree with its page */
+    vm_page_t *vm_page = (vm_page_t *)page_hdr;
+    block_meta_data_t *block = (block_meta_data_t *)ptr - 1;
+    if ((char *)block < (char *)&vm_page->block_meta_data ||
+        (uint32_t)((char *)block - (char *)vm_page) != block->offset) {
+        fprintf(stderr, "xfree: %p is not the start of a block\n", ptr);
+        return NULL;
+    }
+    if (MM_BLOCK_IS_FREE(block)) {
+        fprintf(stderr, "xfree: %p was not allocated here or is already released\n", ptr);
+        return NULL;
     }
+    return vm_page->pg_family;
+}
 
-    /* Safety: ensure block appears to belong to this page (offset check) */
-    if ((uint32_t)((char *)block - (char *)vm_page) != block->offset) {
-        // suspicious: metadata offset mismatches
-        fprintf(stderr, "xfree: metadata offset mismatch for %p (expected %u got %zu)\n",
-                ptr, block->offset, (size_t)((char*)block - (char*)vm_page));
-        // still attempt free but safer to return
+/* Bytes usable behind a user pointer: slot size or block size */
+uint32_t mm_usable_size(void *ptr) {
+    void *page_hdr = MM_GET_PAGE_HDR_FROM_USER_PTR(ptr);
+    if (MM_PAGE_KIND(page_hdr) == MM_PAGE_SLAB)
+        return ((mm_slab_t *)page_hdr)->pg_family->slab_slot_size;
+    if (MM_PAGE_KIND(page_hdr) == MM_PAGE_LARGE)
+        return (uint32_t)((char *)page_hdr + ((mm_large_region_t *)page_hdr)->units * SYSTEM_PAGE_SIZE -
+                          (char *)ptr);
+    return MM_BLOCK_SIZE((block_meta_data_t *)ptr - 1);
+}
+
+/* Release a user pointer to its family; caller holds family->lock */
+void mm_family_free_locked(vm_page_family_t *family, void *ptr) {
+    void *page_hdr = MM_GET_PAGE_HDR_FROM_PTR(ptr);
+    if (MM_PAGE_KIND(page_hdr) == MM_PAGE_SLAB) {
+        if (mm_slab_slot_is_free((mm_slab_t *)page_hdr, ptr))
+            return; /* double free */
+        mm_stats_note_free(family, family->slab_slot_size);
+        mm_slab_free((mm_slab_t *)page_hdr, ptr);
         return;
     }
 
+    block_meta_data_t *block = (block_meta_data_t *)ptr - 1;
+    vm_page_t *vm_page = (vm_page_t *)MM_GET_PAGE_FROM_META_BLOCK(block);
+    if (MM_BLOCK_IS_FREE(block))
+        return; /* double free */
+    mm_stats_note_free(family, MM_BLOCK_SIZE(block));
+
     /* Use mm_free_block to handle merging/heap reinsertion */
     mm_free_block(family, block);
 
     /* If page became empty, free it back to kernel */
     if (mm_is_vm_page_empty(vm_page)) {
-        /* before freeing page, remove its initial block from heap if present */
-        mm_remove_block_from_heap(family, &vm_page->block_meta_data);
+        /* before freeing page, remove its initial block from the free index if present */
+        mm_free_index_remove(family, &vm_page->block_meta_data);
         mm_vm_page_delete_and_free(vm_page);
     }
 }
 
+/* xfree — safe free wrapper used by user code */
+void xfree(void *ptr) {
+    if (!ptr) return;
+
+    vm_page_family_t *family = mm_family_of(ptr);
+    if (!family) return;
+    MM_TRACE_EVENT(MM_TRACE_FREE, family, 0, false, ptr);
+    MM_PROFILE_FREE(family, ptr);
+    if (family->numa_node >= 0)
+        mm_numa_note_free(family);
+
+    /* Large regions go straight back to the kernel */
+    void *page_hdr = MM_GET_PAGE_HDR_FROM_USER_PTR(ptr);
+    if (MM_PAGE_KIND(page_hdr) == MM_PAGE_LARGE) {
+        mm_large_free((mm_large_region_t *)page_hdr, ptr);
+        return;
+    }
+
+    /* Park the block in this thread's cache when possible */
+    if (mm_thread_cache_free(family, ptr))
+        return;
+
+    /* a busy lock queues the block for the current holder instead */
+    if (!mm_family_lock_or_defer(family, ptr))
+        return;
+    MM_REMOTE_FREE_DRAIN(family);
+    mm_family_free_locked(family, ptr);
+    pthread_mutex_unlock(&family->lock);
+}
@@ -0,0 +1,83 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+
+/* Large-object path: requests above a family's large threshold get their own
+ * multi-page mapping. The mm_large_region_t header sits at the start of the
+ * mapping and records how many VM pages to unmap, and the user data follows
+ * it inside the first page, so xfree finds the header by masking; only
+ * page or larger alignments push it to a later page boundary. */
+
+/* Threshold in bytes above which a family's requests take the large path */
+uint32_t mm_large_threshold(vm_page_family_t *family) {
+    /* read without the family lock on the allocation path */
+    uint32_t threshold = __atomic_load_n(&family->large_threshold, __ATOMIC_RELAXED);
+    return threshold ? threshold : MM_MAX_PAGE_ALLOCATABLE_MEMORY;
+}
+
+int mm_set_page_family_large_threshold(const char *struct_name, uint32_t bytes) {
+    vm_page_family_t *family = lookup_page_family_by_name(struct_name);
+    if (!family || bytes > MM_MAX_PAGE_ALLOCATABLE_MEMORY) return -1;
+    __atomic_store_n(&family->large_threshold, bytes, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* Map a dedicated region; only the list insert takes the family lock.
+ * user_data is 16-byte aligned; stricter alignments start further into
+ * the first page, and page or larger ones on a later page boundary, which
+ * the page map resolves back to the header. */
+void *mm_large_alloc(vm_page_family_t *family, uint32_t units, uint32_t alignment) {
+    size_t pad = alignment > 16 ? alignment - 16 : 0;
+    size_t bytes = sizeof(mm_large_region_t) + pad + (size_t)units;
+    size_t pages = (bytes + SYSTEM_PAGE_SIZE - 1) / SYSTEM_PAGE_SIZE;
+
+    mm_large_region_t *region = (mm_large_region_t *)mm_get_new_vm_page_from_kernel((int)pages);
+    if (!region) return NULL;
+    mm_numa_bind(family, region, pages * SYSTEM_PAGE_SIZE);
+    if (mm_page_map_register(region, (uint32_t)pages) != 0) {
+        mm_return_vm_page_to_kernel(region, (int)pages);
+        return NULL;
+    }
+
+    region->page_kind = MM_PAGE_LARGE;
+    region->units = (uint32_t)pages;
+    region->user_size = units;
+    region->pg_family = family;
+    region->prev = NULL;
+    void *user_ptr = (void *)(((uintptr_t)region->user_data + alignment - 1) & ~((uintptr_t)alignment - 1));
+    region->user_offset = (uint32_t)((char *)user_ptr - (char *)region);
+
+    pthread_mutex_lock(&family->lock);
+    MM_REMOTE_FREE_DRAIN(family);
+    region->next = family->large_regions;
+    if (region->next)
+        region->next->prev = region;
+    family->large_regions = region;
+    mm_numa_note_page(family, region);
+    MM_STAT_ADD(family, mmap_calls, 1);
+    MM_STAT_ADD(family, pages_mapped, pages);
+    mm_stats_note_alloc(family, units, mm_usable_size(user_ptr));
+    pthread_mutex_unlock(&family->lock);
+
+    return user_ptr;
+}
+
+/* O(1) release: unlink under the family lock, unmap outside it */
+void mm_large_free(mm_large_region_t *region, void *ptr) {
+    vm_page_family_t *family = region->pg_family;
+
+    pthread_mutex_lock(&family->lock);
+    MM_REMOTE_FREE_DRAIN(family);
+    MM_STAT_ADD(family, munmap_calls, 1);
+    MM_STAT_ADD(family, pages_unmapped, region->units);
+    mm_stats_note_free(family, mm_usable_size(ptr));
+    if (region->prev)
+        region->prev->next = region->next;
+    else
+        family->large_regions = region->next;
+    if (region->next)
+        region->next->prev = region->prev;
+    pthread_mutex_unlock(&family->lock);
+
+    mm_return_vm_page_to_kernel(region, (int)region->units);
+}
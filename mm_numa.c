@@ -0,0 +1,155 @@
+#define _GNU_SOURCE
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+/* NUMA-aware placement.
+ * A NUMA family keeps one hidden family per memory node, each with its own
+ * pages, free index, slabs and empty-page cache. Allocations go to the pool
+ * of the node the calling thread runs on; frees go back to whichever pool
+ * owns the page, as for any family. Pool pages are bound to their node with
+ * mbind(MPOL_PREFERRED) before anything touches them, so placement does
+ * not depend on which thread faults a page in first, and they never pass
+ * through the global empty-page cache. Each new page is checked once to
+ * see where the kernel actually put it. mbind and get_mempolicy are called
+ * through syscall(2), so there is no libnuma dependency.
+ *
+ * Built with -DMM_NUMA_FAKE_NODES=N the pools pretend N nodes are online
+ * and each thread picks its node with mm_numa_fake_set_node; nothing is
+ * bound, so pages land wherever the kernel puts them and allocations by
+ * threads on the other fake nodes show up as remote. */
+
+#ifdef MM_NUMA_FAKE_NODES
+static __thread uint32_t mm_numa_fake_node;
+
+void mm_numa_fake_set_node(uint32_t node) {
+    mm_numa_fake_node = node;
+}
+#endif
+
+static uint32_t mm_numa_online_nodes(void) {
+#ifdef MM_NUMA_FAKE_NODES
+    return MM_NUMA_FAKE_NODES;
+#endif
+    /* "0" or "0-1" or "0,2-3": the highest node number plus one */
+    FILE *f = fopen("/sys/devices/system/node/online", "r");
+    if (!f) return 1;
+    char buf[256];
+    uint32_t nodes = 1;
+    if (fgets(buf, sizeof(buf), f)) {
+        for (char *p = buf; *p; ) {
+            char *end;
+            unsigned long n = strtoul(p, &end, 10);
+            if (end == p) {
+                p++;
+                continue;
+            }
+            if (n + 1 > nodes)
+                nodes = (uint32_t)n + 1;
+            p = end;
+        }
+    }
+    fclose(f);
+    return nodes;
+}
+
+static inline uint32_t mm_numa_current_node(void) {
+#ifdef MM_NUMA_FAKE_NODES
+    return mm_numa_fake_node;
+#endif
+    unsigned int cpu, node;
+    if (getcpu(&cpu, &node) != 0)
+        return 0;
+    return node;
+}
+
+/* Split a family into per-node pools. Only allowed before it owns pages,
+ * and best called after its other settings, which the pools copy. */
+int mm_set_page_family_numa(const char *struct_name) {
+    vm_page_family_t *family = lookup_page_family_by_name(struct_name);
+    if (!family) return -1;
+
+    pthread_mutex_lock(&family->lock);
+    int rc = (family->numa_nodes || family->first_page || family->partial_slabs ||
+              family->full_slabs || family->large_regions) ? -1 : 0;
+    if (rc == 0) {
+        uint32_t nodes = mm_numa_online_nodes();
+        if (nodes > MM_NUMA_MAX_NODES)
+            nodes = MM_NUMA_MAX_NODES;
+        for (uint32_t n = 0; n < nodes && rc == 0; n++) {
+            family->numa_family[n] = mm_instantiate_node_family(family, (int)n);
+            if (!family->numa_family[n])
+                rc = -1;
+        }
+        /* publish last: allocators only look at numa_family once this is set */
+        if (rc == 0)
+            __atomic_store_n(&family->numa_nodes, nodes, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&family->lock);
+    return rc;
+}
+
+/* Pool for the calling thread's node */
+vm_page_family_t *mm_numa_family_for_caller(vm_page_family_t *family) {
+    uint32_t node = mm_numa_current_node();
+    /* a node beyond MM_NUMA_MAX_NODES borrows another node's pool */
+    return family->numa_family[node % family->numa_nodes];
+}
+
+/* Node recorded in the header of the page, slab or large region */
+static int32_t *mm_numa_page_node(void *page_hdr) {
+    switch (MM_PAGE_KIND(page_hdr)) {
+    case MM_PAGE_SLAB:
+        return &((mm_slab_t *)page_hdr)->numa_node;
+    case MM_PAGE_LARGE:
+        return &((mm_large_region_t *)page_hdr)->numa_node;
+    default:
+        return &((vm_page_t *)page_hdr)->numa_node;
+    }
+}
+
+/* Count an allocation as local or remote by where its page landed */
+void mm_numa_note_alloc(vm_page_family_t *family, void *ptr) {
+    int32_t node = *mm_numa_page_node(MM_GET_PAGE_HDR_FROM_PTR(ptr));
+    if (node == (int32_t)mm_numa_current_node())
+        __atomic_fetch_add(&family->stats.numa_local_allocs, 1, __ATOMIC_RELAXED);
+    else
+        __atomic_fetch_add(&family->stats.numa_remote_allocs, 1, __ATOMIC_RELAXED);
+}
+
+/* Count a free issued from a node other than the block's pool */
+void mm_numa_note_free(vm_page_family_t *family) {
+    if ((int32_t)mm_numa_current_node() != family->numa_node)
+        __atomic_fetch_add(&family->stats.numa_remote_frees, 1, __ATOMIC_RELAXED);
+}
+
+/* Prefer the family's node for a fresh, untouched mapping */
+void mm_numa_bind(vm_page_family_t *family, void *region, size_t bytes) {
+#ifdef MM_NUMA_FAKE_NODES
+    return; /* the fake nodes do not exist */
+#endif
+    if (family->numa_node < 0)
+        return;
+    unsigned long mask = 1ul << family->numa_node;
+    syscall(SYS_mbind, region, bytes, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+}
+
+/* Record in its header where the kernel placed a page the family just
+ * formatted. Caller holds family->lock. */
+void mm_numa_note_page(vm_page_family_t *family, void *page) {
+    if (family->numa_node < 0)
+        return;
+    int node = -1;
+    syscall(SYS_get_mempolicy, &node, NULL, 0, page, MPOL_F_NODE | MPOL_F_ADDR);
+    *mm_numa_page_node(page) = node;
+    if (node < 0)
+        return;
+    if (node == family->numa_node)
+        MM_STAT_ADD(family, numa_local_pages, 1);
+    else
+        MM_STAT_ADD(family, numa_remote_pages, 1);
+}
@@ -0,0 +1,134 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+/* Retained empty-page caches.
+ * A page that becomes empty is parked on its family's cache instead of
+ * being unmapped. When a family holds more than empty_high pages, the
+ * surplus down to empty_low is released with MADV_DONTNEED (RSS goes back
+ * to the kernel, the mapping stays) and moved to the global cache, which
+ * any family may reuse. Only when the global cache passes its own high
+ * watermark are pages munmap()ed, again in one batch down to its low mark.
+ * Global pages are tracked out of band so parking them never re-faults
+ * the page we just released, and they come back known-zero. */
+
+typedef struct mm_empty_page_ {
+    struct mm_empty_page_ *next;
+} mm_empty_page_t;
+
+static pthread_mutex_t mm_global_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *mm_global_empty_pages[MM_GLOBAL_EMPTY_PAGES_MAX];
+static uint32_t mm_global_empty_count = 0;
+static uint32_t mm_global_empty_low = MM_DEFAULT_GLOBAL_EMPTY_LOW;
+static uint32_t mm_global_empty_high = MM_DEFAULT_GLOBAL_EMPTY_HIGH;
+
+int mm_set_page_family_empty_cache(const char *struct_name, uint32_t low, uint32_t high) {
+    vm_page_family_t *family = lookup_page_family_by_name(struct_name);
+    if (!family || low > high) return -1;
+    pthread_mutex_lock(&family->lock);
+    family->empty_low = low;
+    family->empty_high = high;
+    pthread_mutex_unlock(&family->lock);
+    return 0;
+}
+
+int mm_set_global_empty_cache(uint32_t low, uint32_t high) {
+    if (low > high || high > MM_GLOBAL_EMPTY_PAGES_MAX) return -1;
+    pthread_mutex_lock(&mm_global_cache_lock);
+    mm_global_empty_low = low;
+    mm_global_empty_high = high;
+    pthread_mutex_unlock(&mm_global_cache_lock);
+    return 0;
+}
+
+/* Reuse a retained page: the family's own first, then the global cache.
+ * Caller holds family->lock. Returns NULL when both caches are empty;
+ * *zeroed tells whether the page content is known to be zero. */
+void *mm_page_cache_take(vm_page_family_t *family, bool *zeroed) {
+    if (family->empty_pages) {
+        mm_empty_page_t *page = (mm_empty_page_t *)family->empty_pages;
+        family->empty_pages = page->next;
+        family->empty_count--;
+        *zeroed = false;
+        return page;
+    }
+    /* global pages may carry another node's binding */
+    if (family->numa_node >= 0)
+        return NULL;
+
+    void *page = NULL;
+    pthread_mutex_lock(&mm_global_cache_lock);
+    if (mm_global_empty_count)
+        page = mm_global_empty_pages[--mm_global_empty_count];
+    pthread_mutex_unlock(&mm_global_cache_lock);
+    *zeroed = true; /* MADV_DONTNEED'd */
+    return page;
+}
+
+/* Park pages in the global cache, unmapping a batch if it overflows.
+ * Pages unmapped here are charged to family, whose lock the caller holds. */
+static void mm_global_cache_put(vm_page_family_t *family, void **pages, uint32_t n) {
+    void *unmap[MM_GLOBAL_EMPTY_PAGES_MAX];
+    uint32_t n_unmap = 0;
+
+    pthread_mutex_lock(&mm_global_cache_lock);
+    for (uint32_t i = 0; i < n; i++) {
+        if (mm_global_empty_count < MM_GLOBAL_EMPTY_PAGES_MAX)
+            mm_global_empty_pages[mm_global_empty_count++] = pages[i];
+        else
+            unmap[n_unmap++] = pages[i];
+    }
+    if (mm_global_empty_count > mm_global_empty_high) {
+        while (mm_global_empty_count > mm_global_empty_low && n_unmap < MM_GLOBAL_EMPTY_PAGES_MAX)
+            unmap[n_unmap++] = mm_global_empty_pages[--mm_global_empty_count];
+    }
+    pthread_mutex_unlock(&mm_global_cache_lock);
+
+    for (uint32_t i = 0; i < n_unmap; i++)
+        mm_return_vm_page_to_kernel(unmap[i], 1);
+    MM_STAT_ADD(family, munmap_calls, n_unmap);
+    MM_STAT_ADD(family, pages_unmapped, n_unmap);
+}
+
+/* Retain an empty page on its family. Caller holds family->lock and has
+ * already unlinked the page from the family's page lists. */
+void mm_page_cache_put(vm_page_family_t *family, void *vm_page) {
+    mm_page_map_unregister(vm_page, 1);
+    mm_empty_page_t *page = (mm_empty_page_t *)vm_page;
+    page->next = (mm_empty_page_t *)family->empty_pages;
+    family->empty_pages = page;
+    family->empty_count++;
+
+    if (family->empty_count <= family->empty_high)
+        return;
+
+    /* Over budget: release RSS for everything above the low mark */
+    void *surplus[MM_GLOBAL_EMPTY_PAGES_MAX];
+    uint32_t n = 0;
+    while (family->empty_count > family->empty_low && n < MM_GLOBAL_EMPTY_PAGES_MAX) {
+        page = (mm_empty_page_t *)family->empty_pages;
+        family->empty_pages = page->next;
+        family->empty_count--;
+        if (family->numa_node >= 0) {
+            /* node-bound pages are not shared through the global cache */
+            mm_return_vm_page_to_kernel(page, 1);
+            MM_STAT_ADD(family, munmap_calls, 1);
+            MM_STAT_ADD(family, pages_unmapped, 1);
+            continue;
+        }
+        madvise(page, SYSTEM_PAGE_SIZE, MADV_DONTNEED);
+        surplus[n++] = page;
+    }
+    mm_global_cache_put(family, surplus, n);
+}
+
+/* Unmap every page parked in the global cache */
+void mm_page_cache_trim(void) {
+    pthread_mutex_lock(&mm_global_cache_lock);
+    uint32_t n = mm_global_empty_count;
+    mm_global_empty_count = 0;
+    for (uint32_t i = 0; i < n; i++)
+        mm_return_vm_page_to_kernel(mm_global_empty_pages[i], 1);
+    pthread_mutex_unlock(&mm_global_cache_lock);
+}
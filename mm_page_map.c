@@ -0,0 +1,113 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+/* Address-to-page map.
+ * A three-level radix tree keyed by address / SYSTEM_PAGE_SIZE that maps
+ * every VM page in use to the header of the page, slab, large region or
+ * arena chunk covering it. Pages are entered when they are formatted and
+ * cleared when they go to an empty-page cache or back to the kernel, so a
+ * lookup tells whether a pointer is ours without reading anything at the
+ * pointer. Lookups are three dependent loads and take no lock; inner
+ * nodes are created under a mutex, published with release stores and
+ * never freed. Covers the 48-bit user address space. */
+
+#define MM_PAGE_MAP_LEVEL_BITS 12
+#define MM_PAGE_MAP_FANOUT (1u << MM_PAGE_MAP_LEVEL_BITS)
+
+typedef struct mm_page_map_leaf_ {
+    void *hdr[MM_PAGE_MAP_FANOUT];
+} mm_page_map_leaf_t;
+
+typedef struct mm_page_map_mid_ {
+    mm_page_map_leaf_t *leaf[MM_PAGE_MAP_FANOUT];
+} mm_page_map_mid_t;
+
+/* the smallest page size (4 KiB) leaves 36 key bits: 12 per level */
+static mm_page_map_mid_t *mm_page_map_root[MM_PAGE_MAP_FANOUT];
+static pthread_mutex_t mm_page_map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uintptr_t mm_page_map_key(const void *ptr) {
+    return (uintptr_t)ptr >> __builtin_ctzl(SYSTEM_PAGE_SIZE);
+}
+
+/* Nodes come straight from mmap: they are allocator metadata, not pages */
+static void *mm_page_map_node_new(size_t bytes) {
+    void *node = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (node == MAP_FAILED) {
+        perror("mm_page_map: mmap failed");
+        return NULL;
+    }
+    return node;
+}
+
+/* Leaf covering key, created when create is set; caller holds mm_page_map_lock
+ * when creating */
+static mm_page_map_leaf_t *mm_page_map_leaf(uintptr_t key, bool create) {
+    uintptr_t r = key >> (2 * MM_PAGE_MAP_LEVEL_BITS);
+    uintptr_t m = (key >> MM_PAGE_MAP_LEVEL_BITS) & (MM_PAGE_MAP_FANOUT - 1);
+    if (r >= MM_PAGE_MAP_FANOUT)
+        return NULL;
+
+    mm_page_map_mid_t *mid = __atomic_load_n(&mm_page_map_root[r], __ATOMIC_ACQUIRE);
+    if (!mid) {
+        if (!create || !(mid = mm_page_map_node_new(sizeof(mm_page_map_mid_t))))
+            return NULL;
+        __atomic_store_n(&mm_page_map_root[r], mid, __ATOMIC_RELEASE);
+    }
+    mm_page_map_leaf_t *leaf = __atomic_load_n(&mid->leaf[m], __ATOMIC_ACQUIRE);
+    if (!leaf) {
+        if (!create || !(leaf = mm_page_map_node_new(sizeof(mm_page_map_leaf_t))))
+            return NULL;
+        __atomic_store_n(&mid->leaf[m], leaf, __ATOMIC_RELEASE);
+    }
+    return leaf;
+}
+
+/* Map units pages starting at hdr to hdr. Returns -1 when the map cannot
+ * grow; the caller must then not hand the pages out. */
+int mm_page_map_register(void *hdr, uint32_t units) {
+    uintptr_t key = mm_page_map_key(hdr);
+    int rc = 0;
+
+    pthread_mutex_lock(&mm_page_map_lock);
+    for (uint32_t i = 0; i < units; i++) {
+        mm_page_map_leaf_t *leaf = mm_page_map_leaf(key + i, true);
+        if (!leaf) {
+            rc = -1;
+            break;
+        }
+        __atomic_store_n(&leaf->hdr[(key + i) & (MM_PAGE_MAP_FANOUT - 1)], hdr, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&mm_page_map_lock);
+
+    if (rc != 0)
+        mm_page_map_unregister(hdr, units);
+    return rc;
+}
+
+/* Forget units pages starting at hdr; pages never registered are fine */
+void mm_page_map_unregister(void *hdr, uint32_t units) {
+    uintptr_t key = mm_page_map_key(hdr);
+    for (uint32_t i = 0; i < units; i++) {
+        mm_page_map_leaf_t *leaf = mm_page_map_leaf(key + i, false);
+        if (leaf)
+            __atomic_store_n(&leaf->hdr[(key + i) & (MM_PAGE_MAP_FANOUT - 1)], NULL, __ATOMIC_RELAXED);
+    }
+}
+
+/* Header of the in-use page covering ptr, or NULL */
+void *mm_page_map_lookup(const void *ptr) {
+    if (!SYSTEM_PAGE_SIZE)
+        return NULL;
+    mm_page_map_leaf_t *leaf = mm_page_map_leaf(mm_page_map_key(ptr), false);
+    if (!leaf)
+        return NULL;
+    return __atomic_load_n(&leaf->hdr[mm_page_map_key(ptr) & (MM_PAGE_MAP_FANOUT - 1)], __ATOMIC_ACQUIRE);
+}
+
+/* Whether ptr points into memory the allocator currently hands out */
+bool mm_owns(const void *ptr) {
+    return mm_page_map_lookup(ptr) != NULL;
+}
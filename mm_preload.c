@@ -0,0 +1,249 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/* malloc interposer: libmm_preload.so (`make preload`).
+ * LD_PRELOAD=./libmm_preload.so serves a program's malloc, calloc, realloc,
+ * free, posix_memalign, aligned_alloc, memalign, valloc, pvalloc and
+ * malloc_usable_size from lmm. Requests are rounded to a size class and
+ * each class is a family registered on first use: slab families in
+ * 16-byte steps up to MM_PRELOAD_SLAB_MAX, then one size-class family per
+ * power of two up to 2 GiB, whose large path takes whatever does not fit
+ * a page. Requests beyond 2 GiB go to the last family's large path.
+ * Every family is 16-byte aligned, as malloc must be. Thread caches and
+ * remote frees are on. MM_PRELOAD_PAGE_SIZE in the environment overrides
+ * the 64 KiB allocator page size. Allocations made while the allocator
+ * initializes come from a static bootstrap buffer and are never freed.
+ * Only the malloc API is exported; the library is built with hidden
+ * visibility so it never binds to a program's own lmm copy. Not fork-safe
+ * while other threads hold a family lock. */
+
+#define MM_PRELOAD_EXPORT __attribute__((visibility("default")))
+#define MM_PRELOAD_ALIGN 16u
+#define MM_PRELOAD_SLAB_MAX 256u
+#define MM_PRELOAD_SLAB_CLASSES (MM_PRELOAD_SLAB_MAX / MM_PRELOAD_ALIGN)
+#define MM_PRELOAD_BLOCK_CLASSES 23  /* 512 bytes .. 2 GiB; larger sizes use the last */
+#define MM_PRELOAD_CLASSES (MM_PRELOAD_SLAB_CLASSES + MM_PRELOAD_BLOCK_CLASSES)
+#define MM_PRELOAD_BOOTSTRAP_BYTES (64u * 1024)
+/* larger than a VM page so that mid-sized objects stay off the mmap path */
+#define MM_PRELOAD_DEFAULT_PAGE_SIZE (64u * 1024)
+
+static mm_family_handle_t mm_preload_families[MM_PRELOAD_CLASSES];
+static pthread_mutex_t mm_preload_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool mm_preload_ready = false;
+static __thread bool mm_preload_initializing = false;
+
+static char mm_preload_bootstrap[MM_PRELOAD_BOOTSTRAP_BYTES] __attribute__((aligned(16)));
+static size_t mm_preload_bootstrap_used = 0;
+
+static inline uint32_t mm_preload_class(size_t size) {
+    if (size <= MM_PRELOAD_SLAB_MAX)
+        return size ? (uint32_t)(size - 1) / MM_PRELOAD_ALIGN : 0;
+    /* 257..512 -> first block class, then one class per power of two */
+    uint32_t cls = MM_PRELOAD_SLAB_CLASSES + (64 - (uint32_t)__builtin_clzl(size - 1)) - 9;
+    return cls < MM_PRELOAD_CLASSES ? cls : MM_PRELOAD_CLASSES - 1;
+}
+
+static inline uint32_t mm_preload_class_size(uint32_t cls) {
+    if (cls < MM_PRELOAD_SLAB_CLASSES)
+        return (cls + 1) * MM_PRELOAD_ALIGN;
+    return 512u << (cls - MM_PRELOAD_SLAB_CLASSES);
+}
+
+/* Carve from the bootstrap buffer; for allocations made by the allocator's
+ * own setup */
+static void *mm_preload_bootstrap_alloc(size_t size) {
+    size = (size + MM_PRELOAD_ALIGN - 1) & ~(size_t)(MM_PRELOAD_ALIGN - 1);
+    size_t off = __atomic_fetch_add(&mm_preload_bootstrap_used, size, __ATOMIC_RELAXED);
+    if (off + size > MM_PRELOAD_BOOTSTRAP_BYTES)
+        return NULL;
+    return mm_preload_bootstrap + off;
+}
+
+static void mm_preload_init(void) {
+    mm_preload_initializing = true;
+    pthread_mutex_lock(&mm_preload_lock);
+    if (!mm_preload_ready) {
+        const char *env = getenv("MM_PRELOAD_PAGE_SIZE");
+        size_t page_size = env ? strtoul(env, NULL, 0) : MM_PRELOAD_DEFAULT_PAGE_SIZE;
+        if (mm_init_with_page_size(page_size, MM_BACKING_DEFAULT) != 0)
+            mm_init();
+        mm_set_thread_cache(true);
+        mm_set_remote_free(true);
+        mm_set_quiet(true);
+        __atomic_store_n(&mm_preload_ready, true, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&mm_preload_lock);
+    mm_preload_initializing = false;
+}
+
+/* Family for class cls, registered on first use */
+static mm_family_handle_t mm_preload_family(uint32_t cls) {
+    mm_family_handle_t family = __atomic_load_n(&mm_preload_families[cls], __ATOMIC_ACQUIRE);
+    if (family)
+        return family;
+
+    mm_preload_initializing = true;
+    pthread_mutex_lock(&mm_preload_lock);
+    family = mm_preload_families[cls];
+    if (!family) {
+        char name[MM_MAX_STRUCT_NAME];
+        uint32_t size = mm_preload_class_size(cls);
+        snprintf(name, sizeof(name), "malloc_%u", size);
+        family = mm_instantiate_new_aligned_family(name, size, MM_PRELOAD_ALIGN);
+        if (family) {
+            if (cls < MM_PRELOAD_SLAB_CLASSES)
+                mm_set_page_family_slab(name);
+            else
+                mm_set_page_family_policy(name, MM_POLICY_SIZE_CLASS);
+            __atomic_store_n(&mm_preload_families[cls], family, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&mm_preload_lock);
+    mm_preload_initializing = false;
+    return family;
+}
+
+static void *mm_preload_alloc(size_t size, bool zero) {
+    if (__builtin_expect(!__atomic_load_n(&mm_preload_ready, __ATOMIC_ACQUIRE), 0)) {
+        if (mm_preload_initializing)
+            return mm_preload_bootstrap_alloc(size); /* zero: static storage */
+        mm_preload_init();
+    }
+    if (size > UINT32_MAX - SYSTEM_PAGE_SIZE) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    uint32_t cls = mm_preload_class(size);
+    if (__builtin_expect(mm_preload_initializing, 0) &&
+        !__atomic_load_n(&mm_preload_families[cls], __ATOMIC_ACQUIRE))
+        return mm_preload_bootstrap_alloc(size);
+    mm_family_handle_t family = mm_preload_family(cls);
+    void *ptr = NULL;
+    if (family) {
+        /* slab slots hold the whole class; block families take the exact size */
+        uint32_t units = cls < MM_PRELOAD_SLAB_CLASSES ? mm_preload_class_size(cls) : (uint32_t)size;
+        ptr = zero ? xcalloc_h(family, units ? units : 1) : xmalloc_h(family, units ? units : 1);
+    }
+    if (!ptr)
+        errno = ENOMEM;
+    return ptr;
+}
+
+MM_PRELOAD_EXPORT void *malloc(size_t size) {
+    return mm_preload_alloc(size, false);
+}
+
+MM_PRELOAD_EXPORT void *calloc(size_t n, size_t size) {
+    size_t bytes;
+    if (__builtin_mul_overflow(n, size, &bytes)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return mm_preload_alloc(bytes, true);
+}
+
+MM_PRELOAD_EXPORT void free(void *ptr) {
+    /* bootstrap memory and anything else not ours is left alone */
+    if (ptr && mm_owns(ptr))
+        xfree(ptr);
+}
+
+MM_PRELOAD_EXPORT size_t malloc_usable_size(void *ptr) {
+    return ptr && mm_owns(ptr) ? mm_usable_size(ptr) : 0;
+}
+
+MM_PRELOAD_EXPORT void *realloc(void *ptr, size_t size) {
+    if (!ptr)
+        return malloc(size);
+    if (!size) {
+        free(ptr);
+        return NULL;
+    }
+    if (!mm_owns(ptr)) {
+        /* bootstrap memory: its size is unknown, copy what can be read */
+        char *end = mm_preload_bootstrap + MM_PRELOAD_BOOTSTRAP_BYTES;
+        if ((char *)ptr < mm_preload_bootstrap || (char *)ptr >= end) {
+            errno = EINVAL;
+            return NULL;
+        }
+        void *moved = malloc(size);
+        if (moved)
+            memcpy(moved, ptr, size < (size_t)(end - (char *)ptr) ? size : (size_t)(end - (char *)ptr));
+        return moved;
+    }
+
+    if (size > UINT32_MAX - SYSTEM_PAGE_SIZE) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* within the same class xrealloc can often resize in place */
+    size_t old_size = mm_usable_size(ptr);
+    uint32_t cls = mm_preload_class(size);
+    if (size <= old_size && cls == mm_preload_class(old_size))
+        return ptr;
+    if (cls >= MM_PRELOAD_SLAB_CLASSES && mm_family_of(ptr) == mm_preload_families[cls]) {
+        void *resized = xrealloc(ptr, (uint32_t)size);
+        if (!resized)
+            errno = ENOMEM;
+        return resized;
+    }
+
+    void *moved = malloc(size);
+    if (moved) {
+        memcpy(moved, ptr, size < old_size ? size : old_size);
+        xfree(ptr);
+    }
+    return moved;
+}
+
+MM_PRELOAD_EXPORT int posix_memalign(void **out, size_t alignment, size_t size) {
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)))
+        return EINVAL;
+    if (alignment <= MM_PRELOAD_ALIGN) {
+        *out = malloc(size);
+        return *out ? 0 : ENOMEM;
+    }
+    if (!__atomic_load_n(&mm_preload_ready, __ATOMIC_ACQUIRE))
+        mm_preload_init();
+    if (size > UINT32_MAX - SYSTEM_PAGE_SIZE - alignment || alignment > UINT32_MAX / 2)
+        return ENOMEM;
+
+    /* slab slots cannot be aligned per call: use the first block class */
+    mm_family_handle_t family = mm_preload_family(mm_preload_class(size > MM_PRELOAD_SLAB_MAX ?
+                                                                   size : MM_PRELOAD_SLAB_MAX + 1));
+    if (!family)
+        return ENOMEM;
+    /* alignments a page cannot honour come back from the large path */
+    void *ptr = xcalloc_aligned(family, size ? (uint32_t)size : 1, (uint32_t)alignment);
+    if (!ptr)
+        return ENOMEM;
+    *out = ptr;
+    return 0;
+}
+
+MM_PRELOAD_EXPORT void *aligned_alloc(size_t alignment, size_t size) {
+    void *ptr = NULL;
+    int rc = posix_memalign(&ptr, alignment < sizeof(void *) ? sizeof(void *) : alignment, size);
+    if (rc)
+        errno = rc;
+    return ptr;
+}
+
+MM_PRELOAD_EXPORT void *memalign(size_t alignment, size_t size) {
+    return aligned_alloc(alignment, size);
+}
+
+MM_PRELOAD_EXPORT void *valloc(size_t size) {
+    return aligned_alloc((size_t)getpagesize(), size);
+}
+
+MM_PRELOAD_EXPORT void *pvalloc(size_t size) {
+    size_t page = (size_t)getpagesize();
+    return aligned_alloc(page, (size + page - 1) & ~(page - 1));
+}
@@ -0,0 +1,395 @@
+#define _GNU_SOURCE
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <sys/mman.h>
+
+/* Sampling heap profiler.
+ * While a profile runs, each thread counts down the bytes it allocates and
+ * samples the allocation that crosses zero, then draws the next distance
+ * from an exponential distribution with mean sample_interval (a Poisson
+ * process over allocated bytes, so every byte is equally likely to be
+ * picked whatever the allocation pattern). A sample keeps the call stack
+ * and lives in its family's table until the object is freed. Dumps weight
+ * each sample back to an estimate of the bytes its call site holds.
+ * Tables and samples are mmapped, never taken from the allocator. A free
+ * checks a bitmap of non-empty buckets, small enough to stay cached, and
+ * only takes the table lock when the pointer's bucket holds samples.
+ * With no profile running the hooks cost one relaxed load. */
+
+#define MM_PROFILE_MAX_DEPTH 32
+#define MM_PROFILE_BUCKETS 4096      /* power of two */
+#define MM_PROFILE_POOL_CHUNK 256    /* samples mapped at a time */
+
+typedef struct mm_profile_sample_ {
+    struct mm_profile_sample_ *next;
+    void *ptr;
+    uint32_t size;
+    uint32_t depth;
+    void *stack[MM_PROFILE_MAX_DEPTH]; /* innermost frame first */
+} mm_profile_sample_t;
+
+typedef struct mm_profile_table_ {
+    uint64_t occupied[MM_PROFILE_BUCKETS / 64]; /* non-empty buckets, read without the lock */
+    pthread_mutex_t lock;
+    uint32_t count;
+    mm_profile_sample_t *bucket[MM_PROFILE_BUCKETS];
+} mm_profile_table_t;
+
+bool mm_profile_active = false;
+
+/* guards the sample pool, table creation and start/stop */
+static pthread_mutex_t mm_profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static mm_profile_sample_t *mm_profile_pool = NULL;
+static uint64_t mm_profile_interval = MM_PROFILE_DEFAULT_INTERVAL;
+static uint32_t mm_profile_gen = 0;
+
+__thread int64_t mm_profile_bytes_left = 0;
+static __thread uint32_t mm_profile_thread_gen = 0;
+static __thread uint64_t mm_profile_rng;
+static __thread bool mm_profile_busy = false; /* backtrace may allocate */
+
+static inline uint32_t mm_profile_hash(const void *ptr) {
+    return (uint32_t)(((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ull >> 40) & (MM_PROFILE_BUCKETS - 1);
+}
+
+static void *mm_profile_map(size_t bytes) {
+    void *mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mm_profile: mmap failed");
+        return NULL;
+    }
+    return mem;
+}
+
+/* Bytes to the next sample: exponential with mean mm_profile_interval */
+static int64_t mm_profile_next_interval(void) {
+    uint64_t x = mm_profile_rng; /* xorshift64* */
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    mm_profile_rng = x;
+    double u = (double)((x * 0x2545F4914F6CDD1Dull) >> 11) * 0x1.0p-53;
+    double mean = (double)__atomic_load_n(&mm_profile_interval, __ATOMIC_RELAXED);
+    return (int64_t)(-log(1.0 - u) * mean) + 1;
+}
+
+/* Return every sample to the pool; caller holds mm_profile_lock */
+static void mm_profile_clear_locked(void) {
+    vm_page_for_families_t *families = __atomic_load_n(&first_vm_page_for_families, __ATOMIC_ACQUIRE);
+    for (; families; families = families->next) {
+        vm_page_family_t *family;
+        ITERATE_PAGE_FAMILIES_BEGIN(families, family) {
+            mm_profile_table_t *table = __atomic_load_n(&family->profile, __ATOMIC_ACQUIRE);
+            if (!table)
+                continue;
+            pthread_mutex_lock(&table->lock);
+            for (uint32_t b = 0; b < MM_PROFILE_BUCKETS; b++) {
+                mm_profile_sample_t *sample = table->bucket[b];
+                while (sample) {
+                    mm_profile_sample_t *next = sample->next;
+                    sample->next = mm_profile_pool;
+                    mm_profile_pool = sample;
+                    sample = next;
+                }
+                table->bucket[b] = NULL;
+            }
+            for (uint32_t w = 0; w < MM_PROFILE_BUCKETS / 64; w++)
+                __atomic_store_n(&table->occupied[w], 0, __ATOMIC_RELAXED);
+            table->count = 0;
+            pthread_mutex_unlock(&table->lock);
+        } ITERATE_PAGE_FAMILIES_END(families, family);
+    }
+}
+
+/* Start sampling about one allocation per sample_interval bytes (0: the
+ * default). Returns -1 when a profile is already running. */
+int mm_profile_start(uint64_t sample_interval) {
+    /* the first backtrace() loads the unwinder, which allocates */
+    void *warm[2];
+    backtrace(warm, 2);
+
+    pthread_mutex_lock(&mm_profile_lock);
+    if (mm_profile_active) {
+        pthread_mutex_unlock(&mm_profile_lock);
+        return -1;
+    }
+    /* samples left over from the last profile may be of freed objects */
+    mm_profile_clear_locked();
+    __atomic_store_n(&mm_profile_interval, sample_interval ? sample_interval : MM_PROFILE_DEFAULT_INTERVAL,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&mm_profile_gen, mm_profile_gen + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&mm_profile_active, true, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&mm_profile_lock);
+    return 0;
+}
+
+/* Stop sampling and drop every live sample */
+void mm_profile_stop(void) {
+    pthread_mutex_lock(&mm_profile_lock);
+    __atomic_store_n(&mm_profile_active, false, __ATOMIC_RELEASE);
+    mm_profile_clear_locked();
+    pthread_mutex_unlock(&mm_profile_lock);
+}
+
+/* Family table, created on its first sample */
+static mm_profile_table_t *mm_profile_table(vm_page_family_t *family) {
+    mm_profile_table_t *table = __atomic_load_n(&family->profile, __ATOMIC_ACQUIRE);
+    if (table)
+        return table;
+    pthread_mutex_lock(&mm_profile_lock);
+    table = family->profile;
+    if (!table && (table = mm_profile_map(sizeof(mm_profile_table_t)))) {
+        pthread_mutex_init(&table->lock, NULL);
+        __atomic_store_n(&family->profile, table, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&mm_profile_lock);
+    return table;
+}
+
+static mm_profile_sample_t *mm_profile_sample_get(void) {
+    pthread_mutex_lock(&mm_profile_lock);
+    if (!mm_profile_pool) {
+        mm_profile_sample_t *chunk = mm_profile_map(MM_PROFILE_POOL_CHUNK * sizeof(mm_profile_sample_t));
+        for (uint32_t i = 0; chunk && i < MM_PROFILE_POOL_CHUNK; i++) {
+            chunk[i].next = mm_profile_pool;
+            mm_profile_pool = &chunk[i];
+        }
+    }
+    mm_profile_sample_t *sample = mm_profile_pool;
+    if (sample)
+        mm_profile_pool = sample->next;
+    pthread_mutex_unlock(&mm_profile_lock);
+    return sample;
+}
+
+static void mm_profile_sample_put(mm_profile_sample_t *sample) {
+    pthread_mutex_lock(&mm_profile_lock);
+    sample->next = mm_profile_pool;
+    mm_profile_pool = sample;
+    pthread_mutex_unlock(&mm_profile_lock);
+}
+
+static void mm_profile_record(vm_page_family_t *family, uint32_t size, void *ptr,
+                              void *const *stack, uint32_t depth) {
+    mm_profile_table_t *table = mm_profile_table(family);
+    mm_profile_sample_t *sample = table ? mm_profile_sample_get() : NULL;
+    if (!sample)
+        return;
+
+    sample->depth = depth;
+    memcpy(sample->stack, stack, depth * sizeof(void *));
+    sample->ptr = ptr;
+    sample->size = size;
+
+    uint32_t b = mm_profile_hash(ptr);
+    pthread_mutex_lock(&table->lock);
+    sample->next = table->bucket[b];
+    table->bucket[b] = sample;
+    __atomic_store_n(&table->occupied[b / 64], table->occupied[b / 64] | (1ull << (b % 64)),
+                     __ATOMIC_RELAXED);
+    table->count++;
+    pthread_mutex_unlock(&table->lock);
+}
+
+/* MM_PROFILE_ALLOC ran this thread's sampling distance down to zero with
+ * the allocation of size bytes at ptr */
+void mm_profile_note_alloc(vm_page_family_t *family, uint32_t size, void *ptr) {
+    uint32_t gen = __atomic_load_n(&mm_profile_gen, __ATOMIC_RELAXED);
+    if (mm_profile_thread_gen != gen) {
+        /* the thread's first allocation in this profile: seed from the
+         * clock and the TLS address, and start counting from here */
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        mm_profile_rng = ((uint64_t)ts.tv_nsec ^ (uintptr_t)&mm_profile_rng) | 1;
+        mm_profile_thread_gen = gen;
+        mm_profile_bytes_left = mm_profile_next_interval();
+        return;
+    }
+    if (mm_profile_busy)
+        return;
+
+    mm_profile_bytes_left = mm_profile_next_interval();
+    mm_profile_busy = true;
+    void *stack[MM_PROFILE_MAX_DEPTH + 1];
+    int depth = backtrace(stack, MM_PROFILE_MAX_DEPTH + 1);
+    /* leave out this function's own frame */
+    if (depth > 1)
+        mm_profile_record(family, size, ptr, stack + 1, (uint32_t)depth - 1);
+    mm_profile_busy = false;
+}
+
+/* Drop ptr's sample, if it has one */
+void mm_profile_note_free(vm_page_family_t *family, void *ptr) {
+    mm_profile_table_t *table = __atomic_load_n(&family->profile, __ATOMIC_ACQUIRE);
+    if (!table)
+        return;
+    uint32_t b = mm_profile_hash(ptr);
+    if (!(__atomic_load_n(&table->occupied[b / 64], __ATOMIC_RELAXED) & (1ull << (b % 64))))
+        return;
+
+    mm_profile_sample_t *found = NULL;
+    pthread_mutex_lock(&table->lock);
+    for (mm_profile_sample_t **link = &table->bucket[b]; *link; link = &(*link)->next) {
+        if ((*link)->ptr == ptr) {
+            found = *link;
+            *link = found->next;
+            table->count--;
+            break;
+        }
+    }
+    if (!table->bucket[b])
+        __atomic_store_n(&table->occupied[b / 64], table->occupied[b / 64] & ~(1ull << (b % 64)),
+                         __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&table->lock);
+    if (found)
+        mm_profile_sample_put(found);
+}
+
+/* ---- dumps ---- */
+
+static int mm_profile_stack_cmp(const void *a, const void *b) {
+    const mm_profile_sample_t *x = a, *y = b;
+    if (x->depth != y->depth)
+        return x->depth < y->depth ? -1 : 1;
+    return memcmp(x->stack, y->stack, x->depth * sizeof(void *));
+}
+
+/* Expected bytes behind one sample of size bytes: an allocation is picked
+ * with probability 1 - exp(-size / interval) */
+static double mm_profile_weight(uint32_t size, uint64_t interval) {
+    return (double)size / (1.0 - exp(-(double)size / (double)interval));
+}
+
+static void mm_profile_put_frame(int fd, void *pc) {
+    Dl_info info;
+    int found = dladdr(pc, &info);
+    if (found && info.dli_sname) {
+        dprintf(fd, "%s", info.dli_sname);
+    } else if (found && info.dli_fname && info.dli_fname[0]) {
+        const char *base = strrchr(info.dli_fname, '/');
+        dprintf(fd, "%s+0x%lx", base ? base + 1 : info.dli_fname,
+                (unsigned long)((char *)pc - (char *)info.dli_fbase));
+    } else {
+        dprintf(fd, "0x%lx", (unsigned long)(uintptr_t)pc);
+    }
+}
+
+/* Copy a family's samples into a scratch mapping, sorted by stack; returns
+ * the count, with *scratch and *scratch_bytes to munmap */
+static uint32_t mm_profile_collect(mm_profile_table_t *table, mm_profile_sample_t **scratch,
+                                   size_t *scratch_bytes) {
+    pthread_mutex_lock(&table->lock);
+    uint32_t n = 0;
+    *scratch = NULL;
+    *scratch_bytes = (size_t)table->count * sizeof(mm_profile_sample_t);
+    if (table->count && (*scratch = mm_profile_map(*scratch_bytes))) {
+        for (uint32_t b = 0; b < MM_PROFILE_BUCKETS; b++)
+            for (mm_profile_sample_t *s = table->bucket[b]; s; s = s->next)
+                (*scratch)[n++] = *s;
+    }
+    pthread_mutex_unlock(&table->lock);
+    if (n)
+        qsort(*scratch, n, sizeof(mm_profile_sample_t), mm_profile_stack_cmp);
+    return n;
+}
+
+/* pprof needs the process's mappings to symbolize addresses */
+static void mm_profile_put_maps(int fd) {
+    dprintf(fd, "\nMAPPED_LIBRARIES:\n");
+    int maps = open("/proc/self/maps", O_RDONLY);
+    if (maps < 0)
+        return;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(maps, buf, sizeof(buf))) > 0)
+        if (write(fd, buf, (size_t)n) != n)
+            break;
+    close(maps);
+}
+
+/* Write the live samples of every family to fd. Folded output has one line
+ * per family and call site with the estimated bytes it holds; pprof output
+ * carries raw sample counts and the interval, and pprof scales them.
+ * Returns -1 when nothing could be written. */
+int mm_profile_dump_fd(int fd, mm_profile_format_t format) {
+    pthread_mutex_lock(&mm_profile_lock);
+    uint64_t interval = mm_profile_interval;
+    pthread_mutex_unlock(&mm_profile_lock);
+
+    vm_page_for_families_t *first = __atomic_load_n(&first_vm_page_for_families, __ATOMIC_ACQUIRE);
+    if (format == MM_PROFILE_PPROF) {
+        /* the header carries the totals */
+        uint64_t total_objs = 0, total_bytes = 0;
+        for (vm_page_for_families_t *families = first; families; families = families->next) {
+            vm_page_family_t *family;
+            ITERATE_PAGE_FAMILIES_BEGIN(families, family) {
+                mm_profile_table_t *table = __atomic_load_n(&family->profile, __ATOMIC_ACQUIRE);
+                if (!table)
+                    continue;
+                pthread_mutex_lock(&table->lock);
+                total_objs += table->count;
+                for (uint32_t b = 0; b < MM_PROFILE_BUCKETS; b++)
+                    for (mm_profile_sample_t *s = table->bucket[b]; s; s = s->next)
+                        total_bytes += s->size;
+                pthread_mutex_unlock(&table->lock);
+            } ITERATE_PAGE_FAMILIES_END(families, family);
+        }
+        if (dprintf(fd, "heap profile: %llu: %llu [%llu: %llu] @ heap_v2/%llu\n",
+                    (unsigned long long)total_objs, (unsigned long long)total_bytes,
+                    (unsigned long long)total_objs, (unsigned long long)total_bytes,
+                    (unsigned long long)interval) < 0)
+            return -1;
+    }
+
+    for (vm_page_for_families_t *families = first; families; families = families->next) {
+        vm_page_family_t *family;
+        ITERATE_PAGE_FAMILIES_BEGIN(families, family) {
+            mm_profile_table_t *table = __atomic_load_n(&family->profile, __ATOMIC_ACQUIRE);
+            if (!table)
+                continue;
+            mm_profile_sample_t *s;
+            size_t scratch_bytes;
+            uint32_t n = mm_profile_collect(table, &s, &scratch_bytes);
+
+            for (uint32_t i = 0, j; i < n; i = j) {
+                uint64_t objs = 0, bytes = 0;
+                double estimate = 0.0;
+                for (j = i; j < n && mm_profile_stack_cmp(&s[i], &s[j]) == 0; j++) {
+                    objs++;
+                    bytes += s[j].size;
+                    estimate += mm_profile_weight(s[j].size, interval);
+                }
+
+                if (format == MM_PROFILE_PPROF) {
+                    dprintf(fd, "%llu: %llu [%llu: %llu] @", (unsigned long long)objs,
+                            (unsigned long long)bytes, (unsigned long long)objs,
+                            (unsigned long long)bytes);
+                    for (uint32_t f = 0; f < s[i].depth; f++)
+                        dprintf(fd, " %p", s[i].stack[f]);
+                    dprintf(fd, "\n");
+                } else {
+                    dprintf(fd, "%s", family->struct_name);
+                    for (uint32_t f = s[i].depth; f-- > 0;) {
+                        dprintf(fd, ";");
+                        mm_profile_put_frame(fd, s[i].stack[f]);
+                    }
+                    dprintf(fd, " %.0f\n", estimate);
+                }
+            }
+            if (s)
+                munmap(s, scratch_bytes);
+        } ITERATE_PAGE_FAMILIES_END(families, family);
+    }
+
+    if (format == MM_PROFILE_PPROF)
+        mm_profile_put_maps(fd);
+    return 0;
+}
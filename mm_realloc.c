@@ -0,0 +1,136 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/* xrealloc.
+ * A block that shrinks keeps its place and gives its tail back to the
+ * free index. A block that grows first tries to absorb the free block
+ * right after it on the page. Only when that neighbour is missing or too
+ * small is the data copied to a new block. Slab slots and large regions
+ * stay put while the new size still fits them. Bytes gained in place are
+ * not cleared, as with realloc. */
+
+/* Resize a live block without moving it; caller holds family->lock */
+static bool mm_realloc_block_locked(vm_page_family_t *family, block_meta_data_t *block, uint32_t units) {
+    uint32_t req_size = MM_ALIGN_REQ_SIZE(units);
+    /* keep the split point where the following block stays aligned */
+    if (family->alignment > MM_MIN_ALIGNMENT)
+        req_size = ((req_size + (uint32_t)sizeof(block_meta_data_t) + family->alignment - 1) &
+                    ~(family->alignment - 1)) - (uint32_t)sizeof(block_meta_data_t);
+
+    uint32_t old_size = MM_BLOCK_SIZE(block);
+    if (req_size > old_size) {
+        block_meta_data_t *next = NEXT_META_BLOCK(block);
+        if (!next || !MM_BLOCK_IS_FREE(next) ||
+            (uint64_t)old_size + sizeof(block_meta_data_t) + MM_BLOCK_SIZE(next) < req_size)
+            return false;
+        mm_free_index_remove(family, next);
+        mm_absorb_next_block(block, next);
+        MM_STAT_ADD(family, realloc_grows_in_place, 1);
+    } else if (req_size < old_size) {
+        MM_STAT_ADD(family, realloc_shrinks_in_place, 1);
+    }
+
+    /* return what is left over, merged with a free successor */
+    block_meta_data_t *tail = mm_split_block(block, req_size);
+    if (tail) {
+        block_meta_data_t *next = NEXT_META_BLOCK(tail);
+        if (next && MM_BLOCK_IS_FREE(next)) {
+            mm_free_index_remove(family, next);
+            mm_union_free_blocks(tail, next);
+        }
+        mm_free_index_insert(family, tail);
+    }
+    mm_stats_note_resize(family, old_size, units, MM_BLOCK_SIZE(block));
+    return true;
+}
+
+/* Resize an allocation to units bytes, keeping its family. Returns the
+ * new address, or NULL (ptr left untouched) when no memory is left.
+ * units == 0 frees ptr. Unlike realloc, a NULL ptr is an error: without
+ * a block there is no family to allocate from. */
+void *xrealloc(void *ptr, uint32_t units) {
+    if (!ptr) {
+        printf("ERROR: xrealloc needs an existing block, allocate it with xmalloc first\n");
+        return NULL;
+    }
+    if (!units) {
+        xfree(ptr);
+        return NULL;
+    }
+
+    vm_page_family_t *family = mm_family_of(ptr);
+    if (!family) return NULL;
+
+    void *page_hdr = MM_GET_PAGE_HDR_FROM_USER_PTR(ptr);
+    uint32_t old_size = mm_usable_size(ptr);
+    bool in_place = false;
+
+    pthread_mutex_lock(&family->lock);
+    MM_REMOTE_FREE_DRAIN(family);
+    MM_STAT_ADD(family, reallocs, 1);
+    if (MM_PAGE_KIND(page_hdr) == MM_PAGE_SLAB) {
+        /* the slot itself never changes size */
+        in_place = units <= family->slab_slot_size;
+        if (in_place)
+            mm_stats_note_resize(family, old_size, units, old_size);
+    } else if (MM_PAGE_KIND(page_hdr) == MM_PAGE_LARGE) {
+        /* stay in the mapping unless the block now belongs on a page */
+        mm_large_region_t *region = (mm_large_region_t *)page_hdr;
+        in_place = units <= old_size &&
+                   (units > mm_large_threshold(family) || MM_ALLOC_NEEDS_REGION(units, family->alignment));
+        if (in_place) {
+            if (units > region->user_size)
+                MM_STAT_ADD(family, realloc_grows_in_place, 1);
+            else if (units < region->user_size)
+                MM_STAT_ADD(family, realloc_shrinks_in_place, 1);
+            region->user_size = units;
+            mm_stats_note_resize(family, old_size, units, old_size);
+        }
+    } else if (MM_BLOCK_IS_FREE((block_meta_data_t *)ptr - 1)) {
+        pthread_mutex_unlock(&family->lock);
+        fprintf(stderr, "xrealloc: %p was already freed\n", ptr);
+        return NULL;
+    } else if (units <= mm_large_threshold(family) && !MM_ALLOC_NEEDS_REGION(units, family->alignment)) {
+        in_place = mm_realloc_block_locked(family, (block_meta_data_t *)ptr - 1, units);
+        if (!in_place) {
+            /* move without dropping the lock the resize attempt already holds */
+            uint32_t dirty_bytes;
+            void *moved = mm_family_alloc_locked(family, units, family->alignment, &dirty_bytes);
+            if (moved) {
+                memcpy(moved, ptr, units < old_size ? units : old_size);
+                mm_family_free_locked(family, ptr);
+            }
+            pthread_mutex_unlock(&family->lock);
+            if (!moved) {
+                mm_report_oom(family);
+                return NULL;
+            }
+            if (family->numa_node >= 0)
+                mm_numa_note_alloc(family, moved);
+            MM_TRACE_EVENT(MM_TRACE_FREE, family, 0, false, ptr);
+            MM_TRACE_EVENT(MM_TRACE_ALLOC, family, units, false, moved);
+            MM_PROFILE_FREE(family, ptr);
+            MM_PROFILE_ALLOC(family, units, moved);
+            return moved;
+        }
+    }
+    pthread_mutex_unlock(&family->lock);
+
+    if (in_place) {
+        MM_TRACE_EVENT(MM_TRACE_FREE, family, 0, false, ptr);
+        MM_TRACE_EVENT(MM_TRACE_ALLOC, family, units, false, ptr);
+        MM_PROFILE_FREE(family, ptr);
+        MM_PROFILE_ALLOC(family, units, ptr);
+        return ptr;
+    }
+
+    /* to or from the large path, or out of a slab slot */
+    void *moved = xmalloc_h(family, units);
+    if (!moved)
+        return NULL;
+    memcpy(moved, ptr, units < old_size ? units : old_size);
+    xfree(ptr);
+    return moved;
+}
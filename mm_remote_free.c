@@ -0,0 +1,79 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* Remote frees.
+ * Families are not owned by threads, so "remote" here means a free that
+ * finds the family lock taken by someone else. With remote frees enabled,
+ * such a free does not wait: it pushes the block on the family's
+ * remote_frees stack with a single CAS, linking it through its first user
+ * word, and returns. Whoever holds the lock next to allocate, free,
+ * resize, flush a thread cache, read statistics or take a snapshot takes
+ * the whole stack with one exchange and frees the batch, coalescing as
+ * usual; only the setters skip it. A thread that queues a block drains
+ * the stack itself if the lock has come free by then, and switching remote
+ * frees off drains every family. Consumers only ever detach the full
+ * list, so the stack has no ABA problem. Until then the blocks still
+ * count as in use. A block freed twice while pending corrupts the stack. */
+
+bool mm_remote_free_enabled = false;
+
+void mm_set_remote_free(bool enable) {
+    __atomic_store_n(&mm_remote_free_enabled, enable, __ATOMIC_RELEASE);
+    if (enable)
+        return;
+
+    vm_page_for_families_t *families = __atomic_load_n(&first_vm_page_for_families, __ATOMIC_ACQUIRE);
+    for (; families; families = families->next) {
+        vm_page_family_t *family;
+        ITERATE_PAGE_FAMILIES_BEGIN(families, family) {
+            mm_remote_free_reclaim(family);
+        } ITERATE_PAGE_FAMILIES_END(families, family);
+    }
+}
+
+/* Take family->lock, or defer the free of ptr when it is busy. Returns
+ * true with the lock held, false when ptr was queued instead. */
+bool mm_family_lock_or_defer(vm_page_family_t *family, void *ptr) {
+    if (!__atomic_load_n(&mm_remote_free_enabled, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&family->lock);
+        return true;
+    }
+    if (pthread_mutex_trylock(&family->lock) == 0)
+        return true;
+
+    void *head = __atomic_load_n(&family->remote_frees, __ATOMIC_RELAXED);
+    do {
+        *(void **)ptr = head;
+    } while (!__atomic_compare_exchange_n(&family->remote_frees, &head, ptr, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    __atomic_fetch_add(&family->stats.remote_frees, 1, __ATOMIC_RELAXED);
+
+    /* the holder may have let go before the push landed; if the family
+     * has gone quiet, nobody else is coming for the stack */
+    if (pthread_mutex_trylock(&family->lock) == 0) {
+        mm_remote_free_drain(family);
+        pthread_mutex_unlock(&family->lock);
+    }
+    return false;
+}
+
+/* Free every queued block; caller holds family->lock */
+void mm_remote_free_drain(vm_page_family_t *family) {
+    void *ptr = __atomic_exchange_n(&family->remote_frees, NULL, __ATOMIC_ACQUIRE);
+    while (ptr) {
+        void *next = *(void **)ptr;
+        mm_family_free_locked(family, ptr);
+        ptr = next;
+    }
+}
+
+/* Free whatever is queued on family, waiting for its lock if need be */
+void mm_remote_free_reclaim(vm_page_family_t *family) {
+    if (!__atomic_load_n(&family->remote_frees, __ATOMIC_RELAXED))
+        return;
+    pthread_mutex_lock(&family->lock);
+    mm_remote_free_drain(family);
+    pthread_mutex_unlock(&family->lock);
+}
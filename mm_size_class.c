@@ -0,0 +1,136 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+
+/* Segregated size-class free lists (MM_POLICY_SIZE_CLASS).
+ * Class c holds free blocks with 2^c <= block_size < 2^(c+1). The list links
+ * live in the free block's own user-data area, and bit c of
+ * size_class_bitmap is set while class c is non-empty.
+ *
+ * MM_POLICY_DENSE keeps the same lists but steers allocations towards the
+ * fullest pages: blocks freed on a page that is more than half free go to
+ * the tail of their class, and an allocation compares up to
+ * MM_DENSE_SCAN_LIMIT fitting blocks and takes the one whose page has the
+ * fewest free bytes. Sparse pages then see no new objects, drain as their
+ * old ones are freed and go back through mm_vm_page_delete_and_free. */
+
+static inline uint32_t mm_size_class_of(uint32_t size) {
+    return 31 - (uint32_t)__builtin_clz(size);
+}
+
+/* more than half of the page's block space is free */
+static inline bool mm_size_class_page_sparse(const vm_page_t *vm_page) {
+    return vm_page->free_bytes > (SYSTEM_PAGE_SIZE - offset_of(vm_page_t, block_meta_data)) / 2;
+}
+
+void mm_size_class_insert(vm_page_family_t *family, block_meta_data_t *block) {
+    uint32_t cls = mm_size_class_of(MM_BLOCK_SIZE(block));
+    mm_free_link_t *link = MM_FREE_LINK(block);
+
+    /* the links land in the payload, which may have been known-zero */
+    vm_page_t *vm_page = (vm_page_t *)MM_GET_PAGE_FROM_META_BLOCK(block);
+    MM_VM_PAGE_TOUCH(vm_page, block->offset + sizeof(block_meta_data_t) + sizeof(mm_free_link_t));
+
+    if (family->policy == MM_POLICY_DENSE && family->size_class_head[cls] &&
+        mm_size_class_page_sparse(vm_page)) {
+        link->next = NULL;
+        link->prev = family->size_class_tail[cls];
+        MM_FREE_LINK(link->prev)->next = block;
+        family->size_class_tail[cls] = block;
+    } else {
+        link->prev = NULL;
+        link->next = family->size_class_head[cls];
+        if (link->next)
+            MM_FREE_LINK(link->next)->prev = block;
+        else
+            family->size_class_tail[cls] = block;
+        family->size_class_head[cls] = block;
+    }
+    family->size_class_bitmap |= (1u << cls);
+    MM_BLOCK_HEAP_INDEX(block) = cls;
+}
+
+int mm_size_class_remove(vm_page_family_t *family, block_meta_data_t *block) {
+    uint32_t cls = MM_BLOCK_HEAP_INDEX(block);
+    if (cls >= MM_SIZE_CLASSES) return 0;
+
+    mm_free_link_t *link = MM_FREE_LINK(block);
+    if (link->prev)
+        MM_FREE_LINK(link->prev)->next = link->next;
+    else
+        family->size_class_head[cls] = link->next;
+    if (link->next)
+        MM_FREE_LINK(link->next)->prev = link->prev;
+    else
+        family->size_class_tail[cls] = link->prev;
+
+    if (!family->size_class_head[cls])
+        family->size_class_bitmap &= ~(1u << cls);
+    MM_BLOCK_HEAP_INDEX(block) = MM_HEAP_INDEX_NONE;
+    return 1;
+}
+
+/* MM_POLICY_DENSE: of the first MM_DENSE_SCAN_LIMIT blocks that fit, walking
+ * classes upwards from req_size's own, take the one on the fullest page */
+static block_meta_data_t *mm_size_class_take_dense(vm_page_family_t *family, uint32_t req_size,
+                                                   uint32_t cls) {
+    block_meta_data_t *best = NULL;
+    uint32_t best_free = UINT32_MAX;
+    int scanned = 0;
+
+    /* blocks too small for the request only occur in its own class */
+    uint32_t mask = family->size_class_bitmap & (~0u << cls);
+    while (mask && scanned < MM_DENSE_SCAN_LIMIT) {
+        uint32_t c = (uint32_t)__builtin_ctz(mask);
+        mask &= mask - 1;
+        int misses = 0;
+        for (block_meta_data_t *block = family->size_class_head[c];
+             block && scanned < MM_DENSE_SCAN_LIMIT; block = MM_FREE_LINK(block)->next) {
+            if (MM_BLOCK_SIZE(block) < req_size) {
+                if (++misses == MM_SIZE_CLASS_SCAN_LIMIT)
+                    break;
+                continue;
+            }
+            scanned++;
+            uint32_t page_free = ((vm_page_t *)MM_GET_PAGE_FROM_META_BLOCK(block))->free_bytes;
+            if (page_free < best_free) {
+                best = block;
+                best_free = page_free;
+            }
+        }
+    }
+    if (best)
+        mm_size_class_remove(family, best);
+    return best;
+}
+
+/* Pop a free block of at least req_size bytes, or NULL.
+ * Any block from a class above req_size's own class fits, so the bitmap
+ * answers most requests in O(1); otherwise a bounded first-fit scan of the
+ * request's own class catches sizes near the top of a class. */
+block_meta_data_t *mm_size_class_take(vm_page_family_t *family, uint32_t req_size) {
+    uint32_t cls = mm_size_class_of(req_size);
+    uint32_t fit_cls = (req_size == (1u << cls)) ? cls : cls + 1;
+
+    if (family->policy == MM_POLICY_DENSE)
+        return mm_size_class_take_dense(family, req_size, cls);
+
+    if (fit_cls < MM_SIZE_CLASSES) {
+        uint32_t mask = family->size_class_bitmap & (~0u << fit_cls);
+        if (mask) {
+            block_meta_data_t *block = family->size_class_head[__builtin_ctz(mask)];
+            mm_size_class_remove(family, block);
+            return block;
+        }
+    }
+
+    block_meta_data_t *block = family->size_class_head[cls];
+    for (int scanned = 0; block && scanned < MM_SIZE_CLASS_SCAN_LIMIT; scanned++) {
+        if (MM_BLOCK_SIZE(block) >= req_size) {
+            mm_size_class_remove(family, block);
+            return block;
+        }
+        block = MM_FREE_LINK(block)->next;
+    }
+    return NULL;
+}
@@ -0,0 +1,169 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Fixed-size slab pages for families registered in slab mode.
+ * A slab page is carved into slab_slot_size slots with no per-object header.
+ * Freed slots are chained through their first word; slots at or past
+ * next_unused have never been handed out. A bitmap at the end of the page
+ * has a bit per slot, set while the slot is free, so a second free of a
+ * slot is caught before it reaches the free list. Slabs with free slots
+ * sit on the family's partial list, exhausted ones on its full list. */
+
+/* Slots a page holds for slot_size, leaving room for the free bitmap */
+static uint32_t mm_slab_slot_count(uint32_t slot_size) {
+    size_t avail = SYSTEM_PAGE_SIZE - sizeof(mm_slab_t) - sizeof(uint64_t);
+    return (uint32_t)(avail * 8 / ((size_t)slot_size * 8 + 1));
+}
+
+static inline uint32_t mm_slab_index(mm_slab_t *slab, void *ptr) {
+    return (uint32_t)(((char *)ptr - slab->slots) / slab->pg_family->slab_slot_size);
+}
+
+/* Set or clear the free bit of slot i; caller holds the family lock. The
+ * word is stored atomically because mm_family_of reads it unlocked. */
+static inline void mm_slab_mark(mm_slab_t *slab, uint32_t i, bool free) {
+    uint64_t word = slab->free_map[i / 64];
+    word = free ? word | (1ull << (i % 64)) : word & ~(1ull << (i % 64));
+    __atomic_store_n(&slab->free_map[i / 64], word, __ATOMIC_RELAXED);
+}
+
+/* Whether the slot at ptr is free, i.e. freeing it again would be a double free */
+bool mm_slab_slot_is_free(mm_slab_t *slab, void *ptr) {
+    uint32_t i = mm_slab_index(slab, ptr);
+    return (__atomic_load_n(&slab->free_map[i / 64], __ATOMIC_RELAXED) >> (i % 64)) & 1;
+}
+
+static void mm_slab_link(mm_slab_t **head, mm_slab_t *slab) {
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head)
+        (*head)->prev = slab;
+    *head = slab;
+}
+
+static void mm_slab_unlink(mm_slab_t **head, mm_slab_t *slab) {
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        *head = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+    slab->next = slab->prev = NULL;
+}
+
+static mm_slab_t *mm_slab_new(vm_page_family_t *family) {
+    bool zeroed = true;
+    mm_slab_t *slab = (mm_slab_t *)mm_page_cache_take(family, &zeroed);
+    if (!slab) {
+        slab = (mm_slab_t *)mm_get_new_vm_page_from_kernel(1);
+        if (!slab) return NULL;
+        mm_numa_bind(family, slab, SYSTEM_PAGE_SIZE);
+        MM_STAT_ADD(family, mmap_calls, 1);
+        MM_STAT_ADD(family, pages_mapped, 1);
+    }
+    if (mm_page_map_register(slab, 1) != 0) {
+        mm_return_vm_page_to_kernel(slab, 1);
+        MM_STAT_ADD(family, munmap_calls, 1);
+        MM_STAT_ADD(family, pages_unmapped, 1);
+        return NULL;
+    }
+
+    slab->page_kind = MM_PAGE_SLAB;
+    slab->pg_family = family;
+    slab->slot_count = mm_slab_slot_count(family->slab_slot_size);
+    slab->free_count = slab->slot_count;
+    slab->next_unused = 0;
+    slab->free_list = NULL;
+    size_t map_words = (slab->slot_count + 63) / 64;
+    slab->free_map = (uint64_t *)((char *)slab + SYSTEM_PAGE_SIZE) - map_words;
+    memset(slab->free_map, 0xff, map_words * sizeof(uint64_t));
+    slab->zeroed = zeroed ? MM_TRUE : MM_FALSE;
+    mm_numa_note_page(family, slab);
+    mm_slab_link(&family->partial_slabs, slab);
+    return slab;
+}
+
+/* Put a family in slab mode; only allowed before the family owns pages */
+int mm_set_page_family_slab(const char *struct_name) {
+    vm_page_family_t *family = lookup_page_family_by_name(struct_name);
+    if (!family) return -1;
+
+    uint32_t slot_size = (family->struct_size + 7u) & ~7u;
+    if (slot_size < sizeof(void *))
+        slot_size = sizeof(void *);
+    slot_size = (slot_size + family->alignment - 1) & ~(family->alignment - 1);
+    if (mm_slab_slot_count(slot_size) == 0)
+        return -1;
+
+    pthread_mutex_lock(&family->lock);
+    int rc = (family->first_page || family->partial_slabs || family->full_slabs) ? -1 : 0;
+    if (rc == 0)
+        family->slab_slot_size = slot_size;
+    pthread_mutex_unlock(&family->lock);
+    return rc;
+}
+
+/* Whether every slot address is a multiple of alignment */
+bool mm_slab_aligned(vm_page_family_t *family, uint32_t alignment) {
+    return family->slab_slot_size % alignment == 0 &&
+           offsetof(mm_slab_t, slots) % alignment == 0;
+}
+
+/* Register a family and put it in slab mode in one step */
+mm_family_handle_t mm_instantiate_new_slab_family(const char *struct_name, uint32_t struct_size) {
+    mm_family_handle_t family = mm_instantiate_new_page_family(struct_name, struct_size);
+    if (family && mm_set_page_family_slab(struct_name) != 0)
+        fprintf(stderr, "Slab mode unavailable for '%s'\n", struct_name);
+    return family;
+}
+
+/* Hand out a slot; *dirty is set when the slot may hold stale data */
+void *mm_slab_alloc(vm_page_family_t *family, bool *dirty) {
+    mm_slab_t *slab = family->partial_slabs;
+    if (!slab) {
+        slab = mm_slab_new(family);
+        if (!slab) return NULL;
+    }
+
+    void *slot;
+    if (slab->free_list) {
+        slot = slab->free_list;
+        slab->free_list = *(void **)slot;
+        *dirty = true;
+    } else {
+        slot = slab->slots + (size_t)slab->next_unused * family->slab_slot_size;
+        slab->next_unused++;
+        *dirty = !slab->zeroed;
+    }
+    mm_slab_mark(slab, mm_slab_index(slab, slot), false);
+
+    if (--slab->free_count == 0) {
+        mm_slab_unlink(&family->partial_slabs, slab);
+        mm_slab_link(&family->full_slabs, slab);
+    }
+    return slot;
+}
+
+/* Return a slot; callers reject slots mm_slab_slot_is_free reports free */
+void mm_slab_free(mm_slab_t *slab, void *ptr) {
+    vm_page_family_t *family = slab->pg_family;
+
+    *(void **)ptr = slab->free_list;
+    slab->free_list = ptr;
+    mm_slab_mark(slab, mm_slab_index(slab, ptr), true);
+
+    if (slab->free_count++ == 0) {
+        mm_slab_unlink(&family->full_slabs, slab);
+        mm_slab_link(&family->partial_slabs, slab);
+    }
+
+    /* Hand empty slabs to the page cache, but keep the last partial one so
+     * a single alloc/free ping-pong does not recycle the page on every call */
+    if (slab->free_count == slab->slot_count &&
+        (slab->prev || slab->next)) {
+        mm_slab_unlink(&family->partial_slabs, slab);
+        mm_page_cache_put(family, slab);
+    }
+}
@@ -0,0 +1,207 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+/* Heap snapshots.
+ * Streams the layout of one family or every family as the binary records
+ * described in mm.h, either to a file descriptor or into a caller buffer.
+ * Nothing is allocated: records are staged in a stack buffer and written
+ * out with write(2), so a snapshot works on a heap in any state. Each
+ * family is walked under its lock; the lock is held across the writes of
+ * that family, so point fd at a file or pipe that drains quickly.
+ * snapshot_report turns the stream into a fragmentation report. */
+
+#define MM_SNAPSHOT_STAGE_BYTES 8192
+#define MM_SNAPSHOT_SIZES_PER_RECORD 256
+
+typedef struct {
+    int fd;             /* -1: copy into buf */
+    char *buf;
+    size_t cap;
+    size_t total;       /* bytes produced so far */
+    bool failed;
+    size_t staged;
+    char stage[MM_SNAPSHOT_STAGE_BYTES];
+} mm_snapshot_sink_t;
+
+static void mm_snapshot_flush(mm_snapshot_sink_t *sink) {
+    const char *p = sink->stage;
+    size_t bytes = sink->staged;
+    while (bytes && !sink->failed) {
+        ssize_t n = write(sink->fd, p, bytes);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            sink->failed = true;
+            break;
+        }
+        p += n;
+        bytes -= (size_t)n;
+    }
+    sink->staged = 0;
+}
+
+static void mm_snapshot_put(mm_snapshot_sink_t *sink, const void *data, size_t bytes) {
+    if (sink->fd < 0) {
+        /* like snprintf: keep counting past the end so the caller can retry */
+        if (sink->total < sink->cap)
+            memcpy(sink->buf + sink->total, data,
+                   bytes < sink->cap - sink->total ? bytes : sink->cap - sink->total);
+        sink->total += bytes;
+        return;
+    }
+    if (sink->staged + bytes > sizeof(sink->stage))
+        mm_snapshot_flush(sink);
+    memcpy(sink->stage + sink->staged, data, bytes);
+    sink->staged += bytes;
+    sink->total += bytes;
+}
+
+static void mm_snapshot_emit(mm_snapshot_sink_t *sink, mm_snapshot_type_t type,
+                             const void *payload, uint32_t len) {
+    mm_snapshot_record_t rec = { .type = (uint16_t)type, .reserved = 0, .len = len };
+    mm_snapshot_put(sink, &rec, sizeof(rec));
+    mm_snapshot_put(sink, payload, len);
+}
+
+static inline uint32_t mm_snapshot_bin(uint32_t size) {
+    uint32_t bin = size ? 31 - __builtin_clz(size) : 0;
+    return bin < MM_SNAPSHOT_HIST_BINS ? bin : MM_SNAPSHOT_HIST_BINS - 1;
+}
+
+/* Runs body for every block in the family's free index, in index order */
+#define MM_SNAPSHOT_FOR_EACH_FREE(family, block, body) \
+    do { \
+        if (MM_POLICY_HAS_SIZE_CLASSES((family)->policy)) { \
+            for (uint32_t __c = 0; __c < MM_SIZE_CLASSES; __c++) \
+                for (block_meta_data_t *block = (family)->size_class_head[__c]; block; \
+                     block = MM_FREE_LINK(block)->next) { body } \
+        } else { \
+            for (uint32_t __i = 0; __i < (family)->heap_size; __i++) { \
+                block_meta_data_t *block = (family)->free_block_heap[__i]; \
+                body \
+            } \
+        } \
+    } while (0)
+
+/* Caller holds family->lock */
+static void mm_snapshot_family(mm_snapshot_sink_t *sink, vm_page_family_t *family) {
+    mm_snapshot_family_t fam;
+    memset(&fam, 0, sizeof(fam));
+    memcpy(fam.name, family->struct_name, MM_MAX_STRUCT_NAME);
+    fam.struct_size = family->struct_size;
+    fam.policy = family->policy;
+    fam.alignment = family->alignment;
+    fam.slab_slot_size = family->slab_slot_size;
+    fam.page_size = (uint32_t)SYSTEM_PAGE_SIZE;
+    fam.page_capacity = (uint32_t)(SYSTEM_PAGE_SIZE - offset_of(vm_page_t, block_meta_data));
+    fam.block_header = sizeof(block_meta_data_t);
+    fam.empty_pages = family->empty_count;
+    fam.reserve_pages = family->reserve_count;
+    fam.bytes_in_use = family->stats.bytes_in_use;
+    MM_SNAPSHOT_FOR_EACH_FREE(family, block, {
+        fam.free_blocks++;
+        fam.free_hist[mm_snapshot_bin(MM_BLOCK_SIZE(block))]++;
+    });
+    mm_snapshot_emit(sink, MM_SNAPSHOT_FAMILY, &fam, sizeof(fam));
+
+    for (vm_page_t *page = family->first_page; page; page = page->next) {
+        mm_snapshot_page_t rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.addr = (uint64_t)(uintptr_t)page;
+        rec.live_blocks = page->live_blocks;
+        rec.free_bytes = page->free_bytes;
+        for (block_meta_data_t *block = &page->block_meta_data; block; block = NEXT_META_BLOCK(block)) {
+            if (MM_BLOCK_IS_FREE(block)) {
+                rec.free_blocks++;
+                if (MM_BLOCK_SIZE(block) > rec.largest_free)
+                    rec.largest_free = MM_BLOCK_SIZE(block);
+            } else {
+                rec.live_bytes += MM_BLOCK_SIZE(block);
+            }
+        }
+        mm_snapshot_emit(sink, MM_SNAPSHOT_PAGE, &rec, sizeof(rec));
+    }
+
+    for (int full = 0; full < 2; full++) {
+        for (mm_slab_t *slab = full ? family->full_slabs : family->partial_slabs; slab; slab = slab->next) {
+            mm_snapshot_slab_t rec = {
+                .addr = (uint64_t)(uintptr_t)slab,
+                .slot_count = slab->slot_count,
+                .free_count = slab->free_count,
+            };
+            mm_snapshot_emit(sink, MM_SNAPSHOT_SLAB, &rec, sizeof(rec));
+        }
+    }
+
+    for (mm_large_region_t *region = family->large_regions; region; region = region->next) {
+        mm_snapshot_large_t rec = {
+            .addr = (uint64_t)(uintptr_t)region,
+            .pages = region->units,
+            .user_size = region->user_size,
+        };
+        mm_snapshot_emit(sink, MM_SNAPSHOT_LARGE, &rec, sizeof(rec));
+    }
+
+    /* free index contents, in chunks so the stack stays small */
+    uint32_t sizes[MM_SNAPSHOT_SIZES_PER_RECORD];
+    uint32_t n = 0;
+    MM_SNAPSHOT_FOR_EACH_FREE(family, block, {
+        sizes[n++] = MM_BLOCK_SIZE(block);
+        if (n == MM_SNAPSHOT_SIZES_PER_RECORD) {
+            mm_snapshot_emit(sink, MM_SNAPSHOT_FREE_SIZES, sizes, n * sizeof(uint32_t));
+            n = 0;
+        }
+    });
+    if (n)
+        mm_snapshot_emit(sink, MM_SNAPSHOT_FREE_SIZES, sizes, n * sizeof(uint32_t));
+}
+
+static void mm_snapshot_run(mm_snapshot_sink_t *sink, vm_page_family_t *only) {
+    mm_snapshot_put(sink, MM_SNAPSHOT_MAGIC, 8);
+
+    vm_page_for_families_t *families = __atomic_load_n(&first_vm_page_for_families, __ATOMIC_ACQUIRE);
+    for (; families; families = families->next) {
+        vm_page_family_t *family;
+        ITERATE_PAGE_FAMILIES_BEGIN(families, family) {
+            if (only && family != only)
+                continue;
+            pthread_mutex_lock(&family->lock);
+            MM_REMOTE_FREE_DRAIN(family);
+            mm_snapshot_family(sink, family);
+            pthread_mutex_unlock(&family->lock);
+        } ITERATE_PAGE_FAMILIES_END(families, family);
+    }
+}
+
+/* Returns the bytes written, or -1 if a write failed */
+ssize_t mm_snapshot_to_fd(mm_family_handle_t family, int fd) {
+    mm_snapshot_sink_t sink;
+    sink.fd = fd;
+    sink.buf = NULL;
+    sink.cap = 0;
+    sink.total = 0;
+    sink.failed = false;
+    sink.staged = 0;
+
+    mm_snapshot_run(&sink, family);
+    mm_snapshot_flush(&sink);
+    return sink.failed ? -1 : (ssize_t)sink.total;
+}
+
+/* Returns the bytes the snapshot needs; buf holds all of it only when that
+ * is no more than len */
+size_t mm_snapshot_to_buffer(mm_family_handle_t family, void *buf, size_t len) {
+    mm_snapshot_sink_t sink;
+    sink.fd = -1;
+    sink.buf = buf;
+    sink.cap = buf ? len : 0;
+    sink.total = 0;
+    sink.failed = false;
+    sink.staged = 0;
+
+    mm_snapshot_run(&sink, family);
+    return sink.total;
+}
@@ -0,0 +1,182 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+
+/* Allocator statistics.
+ * Family counters live in vm_page_family_t and are bumped on paths that
+ * already hold the family lock; kernel traffic is counted here with
+ * relaxed atomics. Readers never take a lock except to find a size-class
+ * family's largest free block, so polling does not stall allocation. */
+
+static uint64_t mm_kernel_pages_mapped;
+static uint64_t mm_kernel_pages_unmapped;
+static uint64_t mm_kernel_mmap_calls;
+static uint64_t mm_kernel_munmap_calls;
+
+#define MM_STAT_LOAD(family_ptr, field) __atomic_load_n(&(family_ptr)->stats.field, __ATOMIC_RELAXED)
+
+/* Caller holds family->lock */
+void mm_stats_note_alloc(vm_page_family_t *family, uint32_t requested, uint32_t granted) {
+    MM_STAT_ADD(family, allocs, 1);
+    MM_STAT_ADD(family, bytes_requested, requested);
+    MM_STAT_ADD(family, bytes_granted, granted);
+    MM_STAT_ADD(family, bytes_in_use, granted);
+    if (family->stats.bytes_in_use > family->stats.peak_bytes_in_use)
+        __atomic_store_n(&family->stats.peak_bytes_in_use, family->stats.bytes_in_use, __ATOMIC_RELAXED);
+}
+
+/* Caller holds family->lock */
+void mm_stats_note_free(vm_page_family_t *family, uint32_t granted) {
+    MM_STAT_ADD(family, frees, 1);
+    MM_STAT_SUB(family, bytes_in_use, granted);
+}
+
+void mm_stats_note_kernel(bool map, uint32_t pages) {
+    if (map) {
+        __atomic_fetch_add(&mm_kernel_mmap_calls, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&mm_kernel_pages_mapped, pages, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&mm_kernel_munmap_calls, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&mm_kernel_pages_unmapped, pages, __ATOMIC_RELAXED);
+    }
+}
+
+/* In-place xrealloc: the block stays live, only its size changes.
+ * Caller holds family->lock. */
+void mm_stats_note_resize(vm_page_family_t *family, uint32_t old_granted, uint32_t requested,
+                          uint32_t granted) {
+    MM_STAT_ADD(family, bytes_requested, requested);
+    MM_STAT_ADD(family, bytes_granted, granted);
+    MM_STAT_SUB(family, bytes_in_use, old_granted);
+    MM_STAT_ADD(family, bytes_in_use, granted);
+    if (family->stats.bytes_in_use > family->stats.peak_bytes_in_use)
+        __atomic_store_n(&family->stats.peak_bytes_in_use, family->stats.bytes_in_use, __ATOMIC_RELAXED);
+}
+
+static uint64_t mm_largest_free_block(vm_page_family_t *family) {
+    uint64_t largest = 0;
+
+    pthread_mutex_lock(&family->lock);
+    MM_REMOTE_FREE_DRAIN(family);
+    if (MM_POLICY_HAS_SIZE_CLASSES(family->policy)) {
+        /* only the highest non-empty class can hold the largest block */
+        if (family->size_class_bitmap) {
+            int cls = 31 - __builtin_clz(family->size_class_bitmap);
+            for (block_meta_data_t *block = family->size_class_head[cls]; block;
+                 block = MM_FREE_LINK(block)->next) {
+                if (MM_BLOCK_SIZE(block) > largest)
+                    largest = MM_BLOCK_SIZE(block);
+            }
+        }
+    } else if (family->heap_size) {
+        largest = MM_BLOCK_SIZE(family->free_block_heap[0]);
+    }
+    pthread_mutex_unlock(&family->lock);
+    return largest;
+}
+
+static void mm_stats_finish(mm_stats_t *out) {
+    out->internal_fragmentation = out->bytes_granted ?
+        1.0 - (double)out->bytes_requested / (double)out->bytes_granted : 0.0;
+}
+
+/* One family's own counters */
+static void mm_stats_read(vm_page_family_t *family, mm_stats_t *out) {
+    /* first, so that queued remote frees are drained before counting */
+    out->largest_free_block = mm_largest_free_block(family);
+    uint64_t tcache_allocs = MM_STAT_LOAD(family, tcache_allocs);
+    uint64_t tcache_frees = MM_STAT_LOAD(family, tcache_frees);
+
+    out->allocs = MM_STAT_LOAD(family, allocs) + tcache_allocs;
+    out->frees = MM_STAT_LOAD(family, frees) + tcache_frees;
+    out->bytes_in_use = MM_STAT_LOAD(family, bytes_in_use);
+    out->peak_bytes_in_use = MM_STAT_LOAD(family, peak_bytes_in_use);
+    out->bytes_requested = MM_STAT_LOAD(family, bytes_requested);
+    out->bytes_granted = MM_STAT_LOAD(family, bytes_granted);
+    out->pages_mapped = MM_STAT_LOAD(family, pages_mapped);
+    out->pages_unmapped = MM_STAT_LOAD(family, pages_unmapped);
+    out->mmap_calls = MM_STAT_LOAD(family, mmap_calls);
+    out->munmap_calls = MM_STAT_LOAD(family, munmap_calls);
+    out->splits = MM_STAT_LOAD(family, splits);
+    out->coalesces = MM_STAT_LOAD(family, coalesces);
+    out->reallocs = MM_STAT_LOAD(family, reallocs);
+    out->realloc_grows_in_place = MM_STAT_LOAD(family, realloc_grows_in_place);
+    out->realloc_shrinks_in_place = MM_STAT_LOAD(family, realloc_shrinks_in_place);
+    out->remote_frees = MM_STAT_LOAD(family, remote_frees);
+    out->heap_size = MM_STAT_LOAD(family, free_blocks);
+    out->numa_remote_allocs = MM_STAT_LOAD(family, numa_remote_allocs);
+    out->numa_local_allocs = MM_STAT_LOAD(family, numa_local_allocs);
+    out->numa_remote_frees = MM_STAT_LOAD(family, numa_remote_frees);
+    out->numa_local_pages = MM_STAT_LOAD(family, numa_local_pages);
+    out->numa_remote_pages = MM_STAT_LOAD(family, numa_remote_pages);
+}
+
+static void mm_stats_accumulate(mm_stats_t *out, const mm_stats_t *one) {
+    out->allocs += one->allocs;
+    out->frees += one->frees;
+    out->bytes_in_use += one->bytes_in_use;
+    out->peak_bytes_in_use += one->peak_bytes_in_use; /* sum of family peaks */
+    out->bytes_requested += one->bytes_requested;
+    out->bytes_granted += one->bytes_granted;
+    out->pages_mapped += one->pages_mapped;
+    out->pages_unmapped += one->pages_unmapped;
+    out->mmap_calls += one->mmap_calls;
+    out->munmap_calls += one->munmap_calls;
+    out->splits += one->splits;
+    out->coalesces += one->coalesces;
+    out->reallocs += one->reallocs;
+    out->realloc_grows_in_place += one->realloc_grows_in_place;
+    out->realloc_shrinks_in_place += one->realloc_shrinks_in_place;
+    out->remote_frees += one->remote_frees;
+    out->heap_size += one->heap_size;
+    if (one->largest_free_block > out->largest_free_block)
+        out->largest_free_block = one->largest_free_block;
+    out->numa_local_allocs += one->numa_local_allocs;
+    out->numa_remote_allocs += one->numa_remote_allocs;
+    out->numa_remote_frees += one->numa_remote_frees;
+    out->numa_local_pages += one->numa_local_pages;
+    out->numa_remote_pages += one->numa_remote_pages;
+}
+
+/* Thread-cache hits not yet folded in by their thread are not included.
+ * A NUMA family reports the sum of its per-node pools. */
+int mm_get_stats(mm_family_handle_t family, mm_stats_t *out) {
+    if (!family || !out) return -1;
+
+    uint32_t nodes = __atomic_load_n(&family->numa_nodes, __ATOMIC_ACQUIRE);
+    if (!nodes) {
+        mm_stats_read(family, out);
+    } else {
+        memset(out, 0, sizeof(*out));
+        for (uint32_t n = 0; n < nodes; n++) {
+            mm_stats_t one;
+            mm_stats_read(family->numa_family[n], &one);
+            mm_stats_accumulate(out, &one);
+        }
+    }
+    mm_stats_finish(out);
+    return 0;
+}
+
+/* Sum over every family; page and syscall counts cover all kernel traffic,
+ * including the global empty-page cache */
+void mm_get_global_stats(mm_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+
+    vm_page_for_families_t *families = __atomic_load_n(&first_vm_page_for_families, __ATOMIC_ACQUIRE);
+    for (; families; families = families->next) {
+        vm_page_family_t *family;
+        ITERATE_PAGE_FAMILIES_BEGIN(families, family) {
+            /* per-node pools are families of their own here */
+            mm_stats_t one;
+            mm_stats_read(family, &one);
+            mm_stats_accumulate(out, &one);
+        } ITERATE_PAGE_FAMILIES_END(families, family);
+    }
+
+    out->pages_mapped = __atomic_load_n(&mm_kernel_pages_mapped, __ATOMIC_RELAXED);
+    out->pages_unmapped = __atomic_load_n(&mm_kernel_pages_unmapped, __ATOMIC_RELAXED);
+    out->mmap_calls = __atomic_load_n(&mm_kernel_mmap_calls, __ATOMIC_RELAXED);
+    out->munmap_calls = __atomic_load_n(&mm_kernel_munmap_calls, __ATOMIC_RELAXED);
+    mm_stats_finish(out);
+}
@@ -0,0 +1,145 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* Per-thread caches of recently freed blocks (tcache).
+ * Each thread owns MM_TCACHE_FAMILIES magazines, direct-mapped by family
+ * address. A magazine holds up to MM_TCACHE_DEPTH user pointers that are
+ * still allocated as far as their family is concerned, so hits on either
+ * side take no lock. Overflow and thread exit hand blocks back to the
+ * owning family under its lock, one lock round-trip per batch. Once the
+ * exit destructor has run, the thread's cache is dead: frees issued later
+ * by other TLS destructors go straight to their family. A pointer already
+ * parked in the bin is a double free and is refused. */
+
+typedef struct mm_tcache_bin_ {
+    vm_page_family_t *family;
+    uint32_t count;
+    uint32_t allocs;  /* hits not yet added to the family statistics */
+    uint32_t frees;
+    void *objs[MM_TCACHE_DEPTH];
+} mm_tcache_bin_t;
+
+static bool mm_tcache_enabled = false;
+static pthread_key_t mm_tcache_key;
+static pthread_once_t mm_tcache_key_once = PTHREAD_ONCE_INIT;
+
+static __thread mm_tcache_bin_t mm_tcache[MM_TCACHE_FAMILIES];
+static __thread bool mm_tcache_registered = false;
+static __thread bool mm_tcache_dead = false;
+
+static inline mm_tcache_bin_t *mm_tcache_bin_for(vm_page_family_t *family) {
+    uintptr_t h = (uintptr_t)family / sizeof(vm_page_family_t);
+    return &mm_tcache[h % MM_TCACHE_FAMILIES];
+}
+
+/* Add the bin's pending hit counts to its family's statistics */
+static void mm_tcache_bin_fold_stats(mm_tcache_bin_t *bin) {
+    if (!bin->family) return;
+    if (bin->allocs)
+        __atomic_fetch_add(&bin->family->stats.tcache_allocs, bin->allocs, __ATOMIC_RELAXED);
+    if (bin->frees)
+        __atomic_fetch_add(&bin->family->stats.tcache_frees, bin->frees, __ATOMIC_RELAXED);
+    bin->allocs = bin->frees = 0;
+}
+
+/* Return the oldest n cached blocks of a bin to their family */
+static void mm_tcache_bin_drain(mm_tcache_bin_t *bin, uint32_t n) {
+    if (!bin->count || !n) return;
+    if (n > bin->count) n = bin->count;
+
+    pthread_mutex_lock(&bin->family->lock);
+    MM_REMOTE_FREE_DRAIN(bin->family);
+    for (uint32_t i = 0; i < n; i++)
+        mm_family_free_locked(bin->family, bin->objs[i]);
+    /* these frees were already counted when the blocks were parked */
+    MM_STAT_SUB(bin->family, frees, n);
+    pthread_mutex_unlock(&bin->family->lock);
+
+    bin->count -= n;
+    memmove(&bin->objs[0], &bin->objs[n], bin->count * sizeof(void *));
+}
+
+static void mm_tcache_thread_exit(void *arg) {
+    (void)arg;
+    mm_thread_cache_flush();
+    mm_tcache_dead = true;
+}
+
+static void mm_tcache_make_key(void) {
+    pthread_key_create(&mm_tcache_key, mm_tcache_thread_exit);
+}
+
+void mm_set_thread_cache(bool enable) {
+    pthread_once(&mm_tcache_key_once, mm_tcache_make_key);
+    __atomic_store_n(&mm_tcache_enabled, enable, __ATOMIC_RELEASE);
+    if (!enable)
+        mm_thread_cache_flush();
+}
+
+/* Hand every block cached by the calling thread back to its family */
+void mm_thread_cache_flush(void) {
+    for (int i = 0; i < MM_TCACHE_FAMILIES; i++) {
+        mm_tcache_bin_fold_stats(&mm_tcache[i]);
+        mm_tcache_bin_drain(&mm_tcache[i], mm_tcache[i].count);
+        /* an empty bin took no lock: drain frees queued on its family */
+        if (mm_tcache[i].family)
+            mm_remote_free_reclaim(mm_tcache[i].family);
+        mm_tcache[i].family = NULL;
+    }
+}
+
+void *mm_thread_cache_alloc(vm_page_family_t *family, uint32_t units) {
+    if (!__atomic_load_n(&mm_tcache_enabled, __ATOMIC_RELAXED) || mm_tcache_dead)
+        return NULL;
+
+    mm_tcache_bin_t *bin = mm_tcache_bin_for(family);
+    if (bin->family != family || !bin->count)
+        return NULL;
+
+    void *ptr = bin->objs[bin->count - 1];
+    uint32_t usable = mm_usable_size(ptr);
+    if (units > usable || usable - units > MM_TCACHE_MAX_SLACK)
+        return NULL;
+
+    bin->count--;
+    if (++bin->allocs == MM_TCACHE_STATS_BATCH)
+        mm_tcache_bin_fold_stats(bin);
+    return ptr;
+}
+
+bool mm_thread_cache_free(vm_page_family_t *family, void *ptr) {
+    if (!__atomic_load_n(&mm_tcache_enabled, __ATOMIC_RELAXED) || mm_tcache_dead)
+        return false;
+
+    /* make sure the exit destructor runs for this thread */
+    if (!mm_tcache_registered) {
+        pthread_setspecific(mm_tcache_key, (void *)1);
+        mm_tcache_registered = true;
+    }
+
+    mm_tcache_bin_t *bin = mm_tcache_bin_for(family);
+    if (bin->family != family) {
+        /* slot collision: evict the other family's blocks */
+        mm_tcache_bin_fold_stats(bin);
+        if (bin->count)
+            mm_tcache_bin_drain(bin, bin->count);
+        bin->family = family;
+    }
+
+    for (uint32_t i = 0; i < bin->count; i++) {
+        if (bin->objs[i] == ptr) {
+            fprintf(stderr, "xfree: %p was not allocated here or is already released\n", ptr);
+            return true;
+        }
+    }
+
+    if (bin->count == MM_TCACHE_DEPTH)
+        mm_tcache_bin_drain(bin, MM_TCACHE_DEPTH / 2);
+
+    bin->objs[bin->count++] = ptr;
+    if (++bin->frees == MM_TCACHE_STATS_BATCH)
+        mm_tcache_bin_fold_stats(bin);
+    return true;
+}
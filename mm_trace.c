@@ -0,0 +1,112 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Allocation tracing.
+ * While a trace is active every xcalloc/xmalloc/xfree (bulk calls included)
+ * appends a record, serialized under one mutex so the file order is an
+ * order the threads really observed. Records are buffered and written with
+ * write(2) when the buffer fills and when the trace stops. bench_suite
+ * replays these files against lmm and glibc malloc. */
+
+#define MM_TRACE_BUFFER_RECORDS 4096
+
+bool mm_trace_active = false;
+
+static pthread_mutex_t mm_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static int mm_trace_fd = -1;
+static uint32_t mm_trace_gen = 0;
+static uint16_t mm_trace_next_id = 0;
+static mm_trace_record_t mm_trace_buf[MM_TRACE_BUFFER_RECORDS];
+static uint32_t mm_trace_count = 0;
+
+static void mm_trace_flush_locked(void) {
+    size_t bytes = mm_trace_count * sizeof(mm_trace_record_t);
+    const char *p = (const char *)mm_trace_buf;
+    while (bytes) {
+        ssize_t n = write(mm_trace_fd, p, bytes);
+        if (n <= 0) {
+            perror("mm_trace: write failed");
+            break;
+        }
+        p += n;
+        bytes -= (size_t)n;
+    }
+    mm_trace_count = 0;
+}
+
+static mm_trace_record_t *mm_trace_slot_locked(void) {
+    if (mm_trace_count == MM_TRACE_BUFFER_RECORDS)
+        mm_trace_flush_locked();
+    return &mm_trace_buf[mm_trace_count++];
+}
+
+int mm_trace_start(const char *path) {
+    pthread_mutex_lock(&mm_trace_lock);
+    if (mm_trace_fd >= 0) {
+        pthread_mutex_unlock(&mm_trace_lock);
+        return -1;
+    }
+    mm_trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (mm_trace_fd < 0) {
+        pthread_mutex_unlock(&mm_trace_lock);
+        perror("mm_trace: open failed");
+        return -1;
+    }
+    if (write(mm_trace_fd, MM_TRACE_MAGIC, 8) != 8)
+        perror("mm_trace: write failed");
+    mm_trace_gen++;
+    mm_trace_next_id = 0;
+    mm_trace_count = 0;
+    __atomic_store_n(&mm_trace_active, true, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&mm_trace_lock);
+    return 0;
+}
+
+void mm_trace_stop(void) {
+    pthread_mutex_lock(&mm_trace_lock);
+    __atomic_store_n(&mm_trace_active, false, __ATOMIC_RELEASE);
+    if (mm_trace_fd >= 0) {
+        mm_trace_flush_locked();
+        close(mm_trace_fd);
+        mm_trace_fd = -1;
+    }
+    pthread_mutex_unlock(&mm_trace_lock);
+}
+
+void mm_trace_record(mm_trace_op_t op, vm_page_family_t *family, uint32_t size, bool zero, void *ptr) {
+    pthread_mutex_lock(&mm_trace_lock);
+    if (mm_trace_fd < 0) {
+        pthread_mutex_unlock(&mm_trace_lock);
+        return;
+    }
+
+    /* introduce the family the first time this session sees it */
+    if (family->trace_gen != mm_trace_gen) {
+        family->trace_gen = mm_trace_gen;
+        family->trace_id = mm_trace_next_id++;
+
+        mm_trace_record_t *rec = mm_trace_slot_locked();
+        memset(rec, 0, sizeof(*rec));
+        rec->op = MM_TRACE_FAMILY;
+        rec->family_id = family->trace_id;
+        rec->size = family->struct_size;
+
+        /* the name occupies the next MM_MAX_STRUCT_NAME bytes of records */
+        char name[MM_MAX_STRUCT_NAME];
+        memcpy(name, family->struct_name, MM_MAX_STRUCT_NAME);
+        name[MM_MAX_STRUCT_NAME - 1] = '\0';
+        for (size_t off = 0; off < MM_MAX_STRUCT_NAME; off += sizeof(mm_trace_record_t))
+            memcpy(mm_trace_slot_locked(), name + off, sizeof(mm_trace_record_t));
+    }
+
+    mm_trace_record_t *rec = mm_trace_slot_locked();
+    rec->op = (uint8_t)op;
+    rec->zero = zero;
+    rec->family_id = family->trace_id;
+    rec->size = size;
+    rec->ptr = (uint64_t)(uintptr_t)ptr;
+    pthread_mutex_unlock(&mm_trace_lock);
+}
@@ -0,0 +1,192 @@
+#include "mm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Offline fragmentation report for heap snapshots (mm_snapshot_to_fd).
+ * Usage: snapshot_report FILE...   ("-" reads standard input)
+ *
+ * Per family it prints occupancy, the free-block histogram and how many
+ * pages a perfect compaction could give back: live blocks, headers
+ * included, packed into as few pages as they fit. That is a lower bound
+ * on the pages the family needs; the gap to the pages it holds is memory
+ * pinned by fragmentation. Blocks parked in thread caches count as live. */
+
+typedef struct {
+    mm_snapshot_family_t fam;
+    uint64_t pages, slabs, large, large_pages;
+    uint64_t live_blocks, live_bytes, free_bytes, free_blocks;
+    uint64_t empty_like_pages;   /* pages with no live block */
+    uint64_t sparse_pages;       /* pages under a quarter full */
+    uint64_t slab_slots, slab_free;
+    uint32_t slab_slot_count;
+    uint32_t largest_free;
+    uint64_t index_sizes;
+} report_family_t;
+
+/* Block pages the live blocks would fill if packed end to end */
+static uint64_t report_pages_needed(const report_family_t *r) {
+    uint64_t bytes = r->live_bytes + r->live_blocks * r->fam.block_header;
+    return (bytes + r->fam.page_capacity - 1) / r->fam.page_capacity;
+}
+
+static void report_print(const report_family_t *r) {
+    const mm_snapshot_family_t *f = &r->fam;
+    if (!r->pages && !r->slabs && !r->large && !f->empty_pages)
+        return;
+
+    printf("family %s (struct %u bytes, %s, align %u)\n", f->name, f->struct_size,
+           f->slab_slot_size ? "slab" : f->policy == MM_POLICY_DENSE ? "dense size classes" :
+           f->policy == MM_POLICY_SIZE_CLASS ? "size classes" : "max heap",
+           f->alignment);
+
+    if (r->pages) {
+        uint64_t held = r->pages * f->page_capacity;
+        uint64_t needed = report_pages_needed(r);
+        printf("  block pages   %8llu  live %llu blocks / %llu bytes, free %llu blocks / %llu bytes\n",
+               (unsigned long long)r->pages, (unsigned long long)r->live_blocks,
+               (unsigned long long)r->live_bytes, (unsigned long long)r->free_blocks,
+               (unsigned long long)r->free_bytes);
+        printf("  utilization   %7.1f%%  (live bytes / page capacity)\n",
+               held ? 100.0 * (double)r->live_bytes / (double)held : 0.0);
+        printf("  external frag %7.1f%%  (1 - largest free %u / total free)\n",
+               r->free_bytes ? 100.0 * (1.0 - (double)r->largest_free / (double)r->free_bytes) : 0.0,
+               r->largest_free);
+        printf("  sparse pages  %8llu  (under 25%% live), %llu with no live block\n",
+               (unsigned long long)r->sparse_pages, (unsigned long long)r->empty_like_pages);
+        printf("  compaction    %8llu  pages releasable (%llu needed)\n",
+               (unsigned long long)(r->pages > needed ? r->pages - needed : 0),
+               (unsigned long long)needed);
+        if (r->index_sizes != f->free_blocks)
+            printf("  warning: %llu free sizes listed, %u expected\n",
+                   (unsigned long long)r->index_sizes, f->free_blocks);
+    }
+
+    if (r->slabs) {
+        uint64_t live = r->slab_slots - r->slab_free;
+        uint64_t needed = r->slab_slot_count ? (live + r->slab_slot_count - 1) / r->slab_slot_count : 0;
+        printf("  slabs         %8llu  %llu of %llu slots live, %llu releasable if compacted\n",
+               (unsigned long long)r->slabs, (unsigned long long)live,
+               (unsigned long long)r->slab_slots,
+               (unsigned long long)(r->slabs > needed ? r->slabs - needed : 0));
+    }
+
+    if (r->large)
+        printf("  large regions %8llu  %llu pages\n",
+               (unsigned long long)r->large, (unsigned long long)r->large_pages);
+    if (f->empty_pages || f->reserve_pages)
+        printf("  cached pages  %8u  empty, %u reserved unformatted\n", f->empty_pages, f->reserve_pages);
+
+    if (f->free_blocks) {
+        printf("  free blocks by size:");
+        for (uint32_t b = 0; b < MM_SNAPSHOT_HIST_BINS; b++) {
+            if (f->free_hist[b])
+                printf(" %u%s:%u", 1u << b, b == MM_SNAPSHOT_HIST_BINS - 1 ? "+" : "", f->free_hist[b]);
+        }
+        printf("\n");
+    }
+}
+
+static int report_file(const char *path) {
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return -1;
+    }
+
+    char magic[8];
+    if (fread(magic, 1, 8, in) != 8 || memcmp(magic, MM_SNAPSHOT_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s: not an lmm snapshot\n", path);
+        if (in != stdin) fclose(in);
+        return -1;
+    }
+    printf("== %s\n", path);
+
+    report_family_t cur;
+    bool have = false;
+    uint64_t total_pages = 0, total_releasable = 0;
+    char payload[sizeof(uint32_t) * 1024];
+    mm_snapshot_record_t rec;
+    int rc = 0;
+
+    for (;;) {
+        bool eof = fread(&rec, sizeof(rec), 1, in) != 1;
+        if (!eof && (rec.len > sizeof(payload) || fread(payload, 1, rec.len, in) != rec.len)) {
+            fprintf(stderr, "%s: truncated record\n", path);
+            rc = -1;
+            eof = true;
+        }
+        if (eof || rec.type == MM_SNAPSHOT_FAMILY) {
+            if (have) {
+                report_print(&cur);
+                uint64_t needed = report_pages_needed(&cur);
+                total_pages += cur.pages + cur.slabs + cur.large_pages;
+                total_releasable += cur.pages > needed ? cur.pages - needed : 0;
+            }
+            if (eof)
+                break;
+            memset(&cur, 0, sizeof(cur));
+            memcpy(&cur.fam, payload, sizeof(cur.fam));
+            cur.fam.name[MM_MAX_STRUCT_NAME - 1] = '\0';
+            have = true;
+            continue;
+        }
+        if (!have)
+            continue;
+
+        switch (rec.type) {
+        case MM_SNAPSHOT_PAGE: {
+            mm_snapshot_page_t *p = (mm_snapshot_page_t *)payload;
+            cur.pages++;
+            cur.live_blocks += p->live_blocks;
+            cur.live_bytes += p->live_bytes;
+            cur.free_bytes += p->free_bytes;
+            cur.free_blocks += p->free_blocks;
+            if (p->largest_free > cur.largest_free)
+                cur.largest_free = p->largest_free;
+            if (!p->live_blocks)
+                cur.empty_like_pages++;
+            if (p->live_bytes * 4 < cur.fam.page_capacity)
+                cur.sparse_pages++;
+            break;
+        }
+        case MM_SNAPSHOT_SLAB: {
+            mm_snapshot_slab_t *s = (mm_snapshot_slab_t *)payload;
+            cur.slabs++;
+            cur.slab_slots += s->slot_count;
+            cur.slab_free += s->free_count;
+            cur.slab_slot_count = s->slot_count;
+            break;
+        }
+        case MM_SNAPSHOT_LARGE: {
+            mm_snapshot_large_t *l = (mm_snapshot_large_t *)payload;
+            cur.large++;
+            cur.large_pages += l->pages;
+            break;
+        }
+        case MM_SNAPSHOT_FREE_SIZES:
+            cur.index_sizes += rec.len / sizeof(uint32_t);
+            break;
+        default:
+            break;  /* newer record kinds are skipped */
+        }
+    }
+
+    printf("total: %llu pages held, %llu releasable by compacting block pages\n",
+           (unsigned long long)total_pages, (unsigned long long)total_releasable);
+    if (in != stdin) fclose(in);
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s SNAPSHOT...\n", argv[0]);
+        return 1;
+    }
+    int rc = 0;
+    for (int i = 1; i < argc; i++)
+        if (report_file(argv[i]) != 0)
+            rc = 1;
+    return rc;
+}
@@ -2,16 +2,1114 @@
 #include <stdio.h>
 #include <stdint.h>
 #include<stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 
 /* Forward declarations for helper debug functions (optional) */
 void dump_lmm_state(void);
 vm_page_family_t *lookup_page_family_by_name(const char *struct_name);
 void xfree(void *ptr);  
 
+/* Feature checks run after the demo; any failure makes the exit status 1 */
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+/* Capture stderr between errors_begin and errors_end, which returns how
+ * many "xfree:" diagnostics were written meanwhile */
+static FILE *errors_file;
+static int errors_saved_fd = -1;
+
+static void errors_begin(void) {
+    fflush(stderr);
+    errors_file = tmpfile();
+    errors_saved_fd = dup(STDERR_FILENO);
+    dup2(fileno(errors_file), STDERR_FILENO);
+}
+
+static int errors_end(void) {
+    fflush(stderr);
+    dup2(errors_saved_fd, STDERR_FILENO);
+    close(errors_saved_fd);
+    rewind(errors_file);
+    char line[256];
+    int count = 0;
+    while (fgets(line, sizeof(line), errors_file))
+        count += strncmp(line, "xfree:", 6) == 0;
+    fclose(errors_file);
+    return count;
+}
+
+/* growth: a family that runs dry maps pages_per_refill pages with one mmap */
+static void check_refill(void) {
+    MM_REG_STRUCT(check_refill, 64);
+    CHECK(mm_set_page_family_refill("check_refill", 0) == -1);
+    CHECK(mm_set_page_family_refill("no_such_family", 4) == -1);
+    CHECK(mm_set_page_family_refill("check_refill", 4) == 0);
+
+    /* whole-page blocks: one per page, all four from the same mapping */
+    char *pages[4];
+    for (int i = 0; i < 4; i++)
+        pages[i] = xcalloc("check_refill", MM_MAX_PAGE_ALLOCATABLE_MEMORY);
+    char *lowest = pages[0];
+    for (int i = 1; i < 4; i++)
+        if (pages[i] < lowest)
+            lowest = pages[i];
+    bool contiguous = true;
+    for (int i = 0; i < 4; i++)
+        contiguous = contiguous && pages[i] && (size_t)(pages[i] - lowest) % SYSTEM_PAGE_SIZE == 0 &&
+                     (size_t)(pages[i] - lowest) < 4 * SYSTEM_PAGE_SIZE;
+    CHECK(contiguous);
+    vm_page_family_t *family = lookup_page_family_by_name("check_refill");
+    CHECK(family->heap_size == 0);
+    for (int i = 0; i < 4; i++)
+        xfree(pages[i]);
+}
+
+/* every heap slot records its own index and the max-heap order holds */
+static bool heap_consistent(vm_page_family_t *family) {
+    for (uint32_t i = 0; i < family->heap_size; i++) {
+        block_meta_data_t *block = family->free_block_heap[i];
+        if (MM_BLOCK_HEAP_INDEX(block) != i || !MM_BLOCK_IS_FREE(block))
+            return false;
+        if (i && MM_BLOCK_SIZE(family->free_block_heap[(i - 1) / 2]) < MM_BLOCK_SIZE(block))
+            return false;
+    }
+    return true;
+}
+
+/* heap_index: coalescing pulls neighbours out of the middle of the heap */
+static void check_heap_index(void) {
+    MM_REG_STRUCT(check_heap, 64);
+    vm_page_family_t *family = lookup_page_family_by_name("check_heap");
+    void *blocks[32];
+    for (int i = 0; i < 32; i++)
+        blocks[i] = xcalloc("check_heap", 64);
+    for (int i = 0; i < 32; i += 2)
+        xfree(blocks[i]);
+    CHECK(heap_consistent(family));
+    uint32_t before = family->heap_size;
+
+    /* freeing 5 merges 4, 5 and 6 into one block */
+    block_meta_data_t *left_free = (block_meta_data_t *)blocks[4] - 1;
+    block_meta_data_t *right_free = (block_meta_data_t *)blocks[6] - 1;
+    CHECK(MM_BLOCK_HEAP_INDEX(right_free) != MM_HEAP_INDEX_NONE);
+    xfree(blocks[5]);
+    CHECK(family->heap_size == before - 1);
+    CHECK(MM_BLOCK_HEAP_INDEX(left_free) != MM_HEAP_INDEX_NONE);
+    CHECK(heap_consistent(family));
+
+    for (int i = 1; i < 32; i += 2)
+        if (i != 5)
+            xfree(blocks[i]);
+    CHECK(heap_consistent(family));
+}
+/* size classes: free blocks sit in the class of their size, the bitmap
+ * mirrors the non-empty lists, and a request takes the lowest fitting class */
+static bool size_classes_consistent(vm_page_family_t *family) {
+    for (uint32_t c = 0; c < MM_SIZE_CLASSES; c++) {
+        bool bit = family->size_class_bitmap & (1u << c);
+        if (bit != (family->size_class_head[c] != NULL))
+            return false;
+        for (block_meta_data_t *b = family->size_class_head[c]; b; b = MM_FREE_LINK(b)->next)
+            if (MM_BLOCK_HEAP_INDEX(b) != c || 31 - (uint32_t)__builtin_clz(MM_BLOCK_SIZE(b)) != c)
+                return false;
+    }
+    return true;
+}
+
+static void check_size_classes(void) {
+    MM_REG_STRUCT(check_classes, 32);
+    CHECK(mm_set_page_family_policy("no_such_family", MM_POLICY_SIZE_CLASS) == -1);
+    CHECK(mm_set_page_family_policy("check_classes", MM_POLICY_SIZE_CLASS) == 0);
+    vm_page_family_t *family = lookup_page_family_by_name("check_classes");
+
+    /* 100, 300 and 1000 byte holes kept apart by live separators */
+    void *b100 = xcalloc("check_classes", 100), *s1 = xcalloc("check_classes", 24);
+    void *b300 = xcalloc("check_classes", 300), *s2 = xcalloc("check_classes", 24);
+    void *b1000 = xcalloc("check_classes", 1000), *s3 = xcalloc("check_classes", 24);
+    CHECK(mm_set_page_family_policy("check_classes", MM_POLICY_MAX_HEAP) == -1);
+    xfree(b100);
+    xfree(b300);
+    xfree(b1000);
+    CHECK(MM_BLOCK_HEAP_INDEX((block_meta_data_t *)b300 - 1) == 8);
+    CHECK(size_classes_consistent(family));
+
+    /* 200 bytes fits class 8 and up; the 300 byte hole is the lowest */
+    void *p = xcalloc("check_classes", 200);
+    CHECK(p == b300);
+    void *tiny = xcalloc("check_classes", 5);
+    block_meta_data_t *tiny_block = (block_meta_data_t *)tiny - 1;
+    CHECK(MM_BLOCK_SIZE(tiny_block) >= MM_MIN_BLOCK_PAYLOAD && MM_BLOCK_SIZE(tiny_block) % 8 == 0);
+    CHECK(size_classes_consistent(family));
+
+    xfree(p);
+    xfree(tiny);
+    xfree(s1);
+    xfree(s2);
+    xfree(s3);
+    CHECK(size_classes_consistent(family));
+}
+/* slab mode: slots reused, a double free rejected without side effects */
+static void check_slab(void) {
+    mm_family_handle_t family = mm_instantiate_new_slab_family("check_slab", 48);
+    CHECK(family != NULL && family->slab_slot_size == 48);
+    void *a = xcalloc_h(family, 48);
+    void *b = xcalloc_h(family, 48);
+    CHECK(a && b && a != b);
+    CHECK(MM_PAGE_KIND(MM_GET_PAGE_HDR_FROM_PTR(a)) == MM_PAGE_SLAB);
+    mm_slab_t *slab = (mm_slab_t *)MM_GET_PAGE_HDR_FROM_PTR(a);
+    xfree(a);
+    CHECK(mm_slab_slot_is_free(slab, a));
+    uint32_t free_count = slab->free_count;
+    errors_begin();
+    xfree(a);
+    CHECK(errors_end() == 1);
+    CHECK(slab->free_count == free_count);
+    void *c = xcalloc_h(family, 48);
+    void *d = xcalloc_h(family, 48);
+    CHECK(c == a && d != c && d != b);
+    CHECK(!mm_slab_slot_is_free(slab, c));
+    void *pair[] = { c, c };
+    errors_begin();
+    xfree_bulk(pair, 2);
+    CHECK(errors_end() == 1);
+    CHECK(slab->free_count == free_count - 1);
+    xfree(b);
+    xfree(d);
+}
+/* thread caches: a freed block is handed straight back to the same
+ * thread, a double free is refused whether the block is still parked or
+ * already back with its family, and exiting threads return what they cached */
+#define CHECK_TCACHE_THREADS 4
+
+static void *tcache_worker(void *arg) {
+    (void)arg;
+    void *live[64] = { 0 };
+    for (int i = 0; i < 50000; i++) {
+        int slot = (i * 7) % 64;
+        xfree(live[slot]);
+        live[slot] = xcalloc("check_tcache", 32 + i % 96);
+    }
+    for (int slot = 0; slot < 32; slot++)
+        xfree(live[slot]);
+    /* the rest stays cached in this thread until it exits */
+    for (int slot = 32; slot < 64; slot++)
+        xfree(live[slot]);
+    return NULL;
+}
+
+static void check_thread_cache(void) {
+    MM_REG_STRUCT(check_tcache, 64);
+    vm_page_family_t *family = lookup_page_family_by_name("check_tcache");
+    mm_set_thread_cache(true);
+    void *a = xcalloc("check_tcache", 64);
+    xfree(a);
+    CHECK(xcalloc("check_tcache", 64) == a);
+
+    xfree(a);
+    errors_begin();
+    xfree(a);
+    CHECK(errors_end() == 1);
+    void *b = xcalloc("check_tcache", 64);
+    void *c = xcalloc("check_tcache", 64);
+    CHECK(b == a && c != a);
+    xfree(c);
+    mm_thread_cache_flush();
+    errors_begin();
+    xfree(c);
+    CHECK(errors_end() == 1);
+    xfree(b);
+
+    pthread_t threads[CHECK_TCACHE_THREADS];
+    for (int t = 0; t < CHECK_TCACHE_THREADS; t++)
+        pthread_create(&threads[t], NULL, tcache_worker, NULL);
+    for (int t = 0; t < CHECK_TCACHE_THREADS; t++)
+        pthread_join(threads[t], NULL);
+    mm_set_thread_cache(false); /* flushes this thread's cache */
+    CHECK(family->first_page == NULL);
+}
+/* name hash: every family is found under its own name across bucket
+ * collisions, and handle allocation skips the lookup entirely */
+static void check_family_hash(void) {
+    enum { N = MM_FAMILY_HASH_BUCKETS + 8 };
+    static mm_family_handle_t handles[N];
+    char name[MM_MAX_STRUCT_NAME];
+    for (int i = 0; i < N; i++) {
+        snprintf(name, sizeof(name), "check_hash_%d", i);
+        handles[i] = mm_instantiate_new_page_family(name, 16 + i % 64);
+    }
+    bool found = true;
+    for (int i = 0; i < N; i++) {
+        snprintf(name, sizeof(name), "check_hash_%d", i);
+        found = found && handles[i] && lookup_page_family_by_name(name) == handles[i];
+    }
+    CHECK(found);
+    CHECK(lookup_page_family_by_name("check_hash_none") == NULL);
+    errors_begin();
+    CHECK(mm_instantiate_new_page_family("check_hash_7", 16) == NULL);
+    errors_end();
+
+    unsigned char *p = xcalloc_h(handles[7], 40);
+    CHECK(p != NULL && mm_family_of(p) == handles[7]);
+    bool zero = true;
+    for (int i = 0; i < 40; i++)
+        zero = zero && p[i] == 0;
+    CHECK(zero);
+    xfree(p);
+}
+/* large regions: own mapping, zeroed, unlinked and unmapped on free */
+static void check_large(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_large", 64);
+    CHECK(mm_set_page_family_large_threshold("check_large", MM_MAX_PAGE_ALLOCATABLE_MEMORY + 1) == -1);
+    CHECK(mm_set_page_family_large_threshold("check_large", 1024) == 0);
+    unsigned char *p = xcalloc_h(family, 100000);
+    CHECK(p != NULL);
+    CHECK(mm_usable_size(p) >= 100000);
+    mm_large_region_t *region = (mm_large_region_t *)MM_GET_PAGE_HDR_FROM_PTR(p);
+    CHECK(MM_PAGE_KIND(region) == MM_PAGE_LARGE && family->large_regions == region);
+    bool zero = true;
+    for (uint32_t i = 0; i < 100000; i++)
+        zero = zero && p[i] == 0;
+    CHECK(zero);
+    memset(p, 0xab, 100000);
+    errors_begin();
+    xfree(p + SYSTEM_PAGE_SIZE);
+    xfree(p + 8);
+    CHECK(errors_end() == 2);
+    CHECK(family->large_regions == region);
+    xfree(p);
+    CHECK(family->large_regions == NULL);
+    /* below the threshold stays on the normal pages */
+    void *small = xcalloc_h(family, 512);
+    CHECK(MM_PAGE_KIND(MM_GET_PAGE_HDR_FROM_PTR(small)) == MM_PAGE_BLOCKS);
+    xfree(small);
+    /* by default only what no longer fits an empty page goes large */
+    void *big = xcalloc("check_heap", MM_MAX_PAGE_ALLOCATABLE_MEMORY + 1);
+    CHECK(big && MM_PAGE_KIND(MM_GET_PAGE_HDR_FROM_PTR(big)) == MM_PAGE_LARGE);
+    xfree(big);
+}
+/* empty-page caches: a family keeps at most empty_high empty pages, trims
+ * to empty_low, and both it and other families reuse what was retained */
+static void check_page_cache(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_pcache", 64);
+    mm_family_handle_t other = mm_instantiate_new_page_family("check_pcache2", 64);
+    CHECK(mm_set_page_family_empty_cache("check_pcache", 3, 2) == -1);
+    CHECK(mm_set_global_empty_cache(0, MM_GLOBAL_EMPTY_PAGES_MAX + 1) == -1);
+    CHECK(mm_set_page_family_empty_cache("check_pcache", 1, 2) == 0);
+
+    void *pages[4];
+    for (int i = 0; i < 4; i++)
+        pages[i] = xcalloc_h(family, MM_MAX_PAGE_ALLOCATABLE_MEMORY);
+    for (int i = 0; i < 3; i++)
+        xfree(pages[i]);
+    /* the third empty page passes the high mark: two move to the global cache */
+    CHECK(family->empty_count == 1);
+    xfree(pages[3]);
+    CHECK(family->empty_count == 2);
+
+    void *again = xcalloc_h(family, MM_MAX_PAGE_ALLOCATABLE_MEMORY);
+    CHECK(family->empty_count == 1);
+    CHECK(again == pages[0] || again == pages[3]);
+    void *elsewhere = xcalloc_h(other, MM_MAX_PAGE_ALLOCATABLE_MEMORY);
+    CHECK(elsewhere == pages[1] || elsewhere == pages[2]);
+    xfree(again);
+    xfree(elsewhere);
+}
+/* zeroing: fresh pages need no memset beyond free-block metadata,
+ * recycled pages are cleared by xcalloc but not by xmalloc */
+static void check_zeroing(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_zero", 64);
+    uint32_t dirty_first = 1, dirty_second = 1;
+    pthread_mutex_lock(&family->lock);
+    void *first = mm_family_alloc_locked(family, 64, MM_MIN_ALIGNMENT, &dirty_first);
+    void *second = mm_family_alloc_locked(family, 64, MM_MIN_ALIGNMENT, &dirty_second);
+    pthread_mutex_unlock(&family->lock);
+    CHECK(first && second && dirty_first <= MM_FREE_BLOCK_META_BYTES &&
+          dirty_second <= MM_FREE_BLOCK_META_BYTES);
+    xfree(first);
+    xfree(second);
+
+    /* the emptied page stays on the family's own cache, contents intact */
+    unsigned char *p = xcalloc_h(family, MM_MAX_PAGE_ALLOCATABLE_MEMORY);
+    memset(p, 0xab, MM_MAX_PAGE_ALLOCATABLE_MEMORY);
+    xfree(p);
+    unsigned char *q = xmalloc_h(family, MM_MAX_PAGE_ALLOCATABLE_MEMORY);
+    CHECK(q == p && q[MM_MAX_PAGE_ALLOCATABLE_MEMORY / 2] == 0xab &&
+          q[MM_MAX_PAGE_ALLOCATABLE_MEMORY - 1] == 0xab);
+    xfree(q);
+    unsigned char *z = xcalloc_h(family, MM_MAX_PAGE_ALLOCATABLE_MEMORY);
+    bool zero = true;
+    for (uint32_t i = 0; i < MM_MAX_PAGE_ALLOCATABLE_MEMORY; i++)
+        zero = zero && z[i] == 0;
+    CHECK(z == p && zero);
+    xfree(z);
+}
+/* bulk: distinct zeroed objects; a repeated pointer is reported once and
+ * everything else released */
+static void check_bulk(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_bulk", 48);
+    mm_set_page_family_large_threshold("check_bulk", 1024);
+    void *objs[104];
+    CHECK(xcalloc_bulk(family, 48, 100, objs) == 100);
+    bool ok = true;
+    for (int i = 0; i < 100; i++) {
+        const unsigned char *bytes = objs[i];
+        for (int b = 0; b < 48; b++)
+            ok = ok && bytes[b] == 0;
+        ok = ok && (i == 0 || objs[i] != objs[i - 1]) && mm_family_of(objs[i]) == family;
+        memset(objs[i], 0xcd, 48);
+    }
+    CHECK(ok);
+    objs[100] = xcalloc_h(family, 8192); /* large region */
+    objs[101] = NULL;
+    objs[102] = objs[10];                /* freed twice in one batch */
+    objs[103] = (char *)objs[20] + 8;    /* inside a block */
+
+    errors_begin();
+    xfree_bulk(objs, 104);
+    CHECK(errors_end() == 2);
+    CHECK(family->first_page == NULL && family->large_regions == NULL);
+}
+/* page occupancy: live_blocks and free_bytes agree with a walk of the
+ * page's block list through allocations, frees, merges and bulk frees */
+static bool page_counters_consistent(vm_page_t *vm_page) {
+    uint32_t live = 0, free_bytes = 0;
+    for (block_meta_data_t *b = &vm_page->block_meta_data; b; b = NEXT_META_BLOCK(b)) {
+        if (MM_BLOCK_IS_FREE(b))
+            free_bytes += MM_BLOCK_SIZE(b);
+        else
+            live++;
+    }
+    return live == vm_page->live_blocks && free_bytes == vm_page->free_bytes;
+}
+
+static void check_page_counters(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_counters", 64);
+    void *blocks[6];
+    for (int i = 0; i < 6; i++)
+        blocks[i] = xcalloc_h(family, 100 * (i + 1));
+    vm_page_t *vm_page = (vm_page_t *)MM_GET_PAGE_HDR_FROM_PTR(blocks[0]);
+    CHECK(vm_page->live_blocks == 6 && page_counters_consistent(vm_page));
+    xfree(blocks[2]);
+    xfree(blocks[1]); /* merges with 2 */
+    CHECK(vm_page->live_blocks == 4 && page_counters_consistent(vm_page));
+    void *refill = xcalloc_h(family, 150);
+    CHECK(page_counters_consistent(vm_page));
+    void *batch[] = { blocks[0], blocks[3], refill };
+    xfree_bulk(batch, 3);
+    CHECK(vm_page->live_blocks == 2 && page_counters_consistent(vm_page));
+    xfree(blocks[4]);
+    CHECK(vm_page->live_blocks == 1 && !mm_is_vm_page_empty(vm_page));
+    xfree(blocks[5]);
+    CHECK(family->first_page == NULL);
+}
+/* block headers (32-byte linked or -DMM_COMPACT_HEADERS): adjacent blocks
+ * coalesce whatever order they are freed in */
+static void check_blocks(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_blocks", 64);
+#ifdef MM_COMPACT_HEADERS
+    CHECK(sizeof(block_meta_data_t) == 8);
+#endif
+    char *a = xcalloc_h(family, 100);
+    char *b = xcalloc_h(family, 200);
+    char *c = xcalloc_h(family, 300);
+    char *d = xcalloc_h(family, 64); /* keeps the page mapped */
+    CHECK((block_meta_data_t *)b - 1 == NEXT_META_BLOCK((block_meta_data_t *)a - 1));
+    CHECK((block_meta_data_t *)c - 1 == NEXT_META_BLOCK((block_meta_data_t *)b - 1));
+    CHECK((block_meta_data_t *)d - 1 == NEXT_META_BLOCK((block_meta_data_t *)c - 1));
+    memset(a, 1, 100);
+    memset(b, 2, 200);
+    memset(c, 3, 300);
+
+    xfree(a);
+    xfree(c);
+    xfree(b);
+    block_meta_data_t *merged = (block_meta_data_t *)a - 1;
+    CHECK(MM_BLOCK_IS_FREE(merged));
+    CHECK(NEXT_META_BLOCK(merged) == (block_meta_data_t *)d - 1);
+#ifdef MM_COMPACT_HEADERS
+    CHECK((((block_meta_data_t *)d - 1)->size_flags & MM_BLOCK_PREV_FREE) != 0);
+#endif
+
+    CHECK(MM_BLOCK_SIZE(merged) >= 600 + 2 * sizeof(block_meta_data_t));
+    xfree(d);
+    CHECK(family->first_page == NULL);
+}
+/* alignment: explicit and family-default alignments below a page, and
+ * aligned requests whose padding no page could hold go to large regions,
+ * bulk ones included */
+static void check_alignment(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_align", 64);
+    bool ok = true;
+    void *ptrs[5 * 6];
+    int n = 0;
+    for (uint32_t alignment = 16; alignment <= MM_MAX_ALIGNMENT; alignment *= 2) {
+        for (uint32_t units = 1; units <= 1000; units += 333) {
+            unsigned char *p = xcalloc_aligned(family, units, alignment);
+            ok = ok && p && (uintptr_t)p % alignment == 0 && mm_usable_size(p) >= units;
+            for (uint32_t i = 0; p && i < units; i++)
+                ok = ok && p[i] == 0;
+            if (p)
+                memset(p, 0xee, units);
+            ptrs[n++] = p;
+        }
+    }
+    CHECK(ok);
+    for (int i = 0; i < n; i++)
+        xfree(ptrs[i]);
+    CHECK(xcalloc_aligned(family, 64, 24) == NULL);
+
+    mm_family_handle_t aligned = MM_REG_STRUCT_ALIGNED(check_align64, 40, 64);
+    void *a = xcalloc_h(aligned, 40), *b = xcalloc_h(aligned, 40);
+    CHECK(a && b && (uintptr_t)a % 64 == 0 && (uintptr_t)b % 64 == 0);
+    CHECK(mm_set_page_family_alignment("check_align64", 16) == -1);
+    xfree(a);
+    xfree(b);
+
+    /* just under a page: the alignment padding no longer fits beside the block */
+    mm_family_handle_t near = MM_REG_STRUCT_ALIGNED(check_near_page, 64, 16);
+    ok = true;
+    for (uint32_t units = MM_MAX_PAGE_ALLOCATABLE_MEMORY - 600; units <= MM_MAX_PAGE_ALLOCATABLE_MEMORY; units++) {
+        uint32_t alignment = units % 2 ? 16 : 256;
+        char *p = xcalloc_aligned(near, units, alignment);
+        ok = ok && p && (uintptr_t)p % alignment == 0;
+        if (p) {
+            p = xrealloc(p, units + 1);
+            ok = ok && p && (uintptr_t)p % 16 == 0;
+        }
+        xfree(p);
+    }
+    CHECK(ok);
+    void *batch[3];
+    CHECK(xcalloc_bulk(near, MM_MAX_PAGE_ALLOCATABLE_MEMORY - 8, 3, batch) == 3);
+    for (int i = 0; i < 3; i++)
+        CHECK(MM_PAGE_KIND(MM_GET_PAGE_HDR_FROM_PTR(batch[i])) == MM_PAGE_LARGE &&
+              (uintptr_t)batch[i] % 16 == 0);
+    xfree_bulk(batch, 3);
+    CHECK(near->first_page == NULL && near->large_regions == NULL);
+}
+
+/* statistics: allocation counters follow every path, and each kernel
+ * map or unmap is charged to the family whose pages it moved */
+static void check_stats(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_stats", 64);
+    mm_family_handle_t slabs = mm_instantiate_new_slab_family("check_stats_slab", 48);
+    mm_set_page_family_refill("check_stats", 1);
+    mm_set_page_family_empty_cache("check_stats", 0, 0);
+    mm_set_page_family_empty_cache("check_stats_slab", 0, 0);
+    mm_set_global_empty_cache(0, 0);
+    mm_stats_t before, after, s;
+    mm_get_global_stats(&before);
+
+    char *a = xcalloc_h(family, 100);
+    char *b = xcalloc_h(family, MM_MAX_PAGE_ALLOCATABLE_MEMORY);
+    char *big = xcalloc_h(family, 3 * SYSTEM_PAGE_SIZE);
+    CHECK(mm_get_stats(family, &s) == 0);
+    CHECK(s.allocs == 3 && s.frees == 0);
+    CHECK(s.bytes_requested == 100 + MM_MAX_PAGE_ALLOCATABLE_MEMORY + 3 * SYSTEM_PAGE_SIZE);
+    CHECK(s.bytes_in_use == s.bytes_granted && s.bytes_granted >= s.bytes_requested);
+    CHECK(s.pages_mapped >= 6 && s.mmap_calls == 3);
+    xfree(a);
+    xfree(b);
+    xfree(big);
+    CHECK(mm_get_stats(family, &s) == 0);
+    CHECK(s.frees == 3 && s.bytes_in_use == 0);
+    CHECK(s.pages_mapped == s.pages_unmapped && s.mmap_calls == s.munmap_calls);
+    uint64_t block_pages = s.pages_mapped;
+
+    /* two slabs; the emptied one is released, the last partial one kept */
+    void *slots[SYSTEM_PAGE_SIZE / 48 + 1];
+    uint32_t n = 0;
+    do {
+        slots[n++] = xcalloc_h(slabs, 48);
+    } while (MM_GET_PAGE_HDR_FROM_PTR(slots[n - 1]) == MM_GET_PAGE_HDR_FROM_PTR(slots[0]));
+    xfree_bulk(slots, n);
+    CHECK(mm_get_stats(slabs, &s) == 0);
+    CHECK(s.allocs == n && s.frees == n && s.bytes_in_use == 0);
+    CHECK(s.pages_mapped == 2 && s.pages_unmapped == 1);
+
+    mm_get_global_stats(&after);
+    CHECK(after.pages_mapped - before.pages_mapped == block_pages + 2);
+    CHECK(after.pages_unmapped - before.pages_unmapped == block_pages + 1);
+    mm_set_global_empty_cache(MM_DEFAULT_GLOBAL_EMPTY_LOW, MM_DEFAULT_GLOBAL_EMPTY_HIGH);
+}
+
+/* snapshots: the buffer and fd variants produce the same stream, its
+ * records describe the family, and snapshot_report reads it back */
+static void check_snapshot(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_snapshot", 64);
+    char *a = xcalloc_h(family, 100);
+    char *b = xcalloc_h(family, 200);
+    char *c = xcalloc_h(family, 300);
+    char *big = xcalloc_h(family, 3 * SYSTEM_PAGE_SIZE);
+    xfree(b);
+
+    static char buf[16384], back[16384];
+    size_t need = mm_snapshot_to_buffer(family, NULL, 0);
+    CHECK(need > 8 && need <= sizeof(buf));
+    CHECK(mm_snapshot_to_buffer(family, buf, sizeof(buf)) == need);
+
+    char path[] = "/tmp/check_snapshot.XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0 && mm_snapshot_to_fd(family, fd) == (ssize_t)need);
+    CHECK(pread(fd, back, sizeof(back), 0) == (ssize_t)need && memcmp(buf, back, need) == 0);
+    close(fd);
+
+    /* walk the records */
+    CHECK(memcmp(buf, MM_SNAPSHOT_MAGIC, 8) == 0);
+    uint32_t families = 0, pages = 0, live = 0, large = 0, sizes = 0;
+    mm_snapshot_family_t fam;
+    memset(&fam, 0, sizeof(fam));
+    for (size_t off = 8; off + sizeof(mm_snapshot_record_t) <= need;) {
+        mm_snapshot_record_t rec;
+        memcpy(&rec, buf + off, sizeof(rec));
+        char *payload = buf + off + sizeof(rec);
+        if (rec.type == MM_SNAPSHOT_FAMILY) {
+            memcpy(&fam, payload, sizeof(fam));
+            families++;
+        } else if (rec.type == MM_SNAPSHOT_PAGE) {
+            pages++;
+            live += ((mm_snapshot_page_t *)payload)->live_blocks;
+        } else if (rec.type == MM_SNAPSHOT_LARGE) {
+            large++;
+        } else if (rec.type == MM_SNAPSHOT_FREE_SIZES) {
+            sizes += rec.len / sizeof(uint32_t);
+        }
+        off += sizeof(rec) + rec.len;
+    }
+    CHECK(families == 1 && strcmp(fam.name, "check_snapshot") == 0);
+    CHECK(pages == 1 && live == 2 && large == 1);
+    CHECK(fam.free_blocks >= 1 && sizes == fam.free_blocks);
+    CHECK(fam.bytes_in_use == family->stats.bytes_in_use);
+
+    /* the report tool, when it was built next to this binary */
+    if (access("./snapshot_report", X_OK) == 0) {
+        char cmd[64], line[256];
+        snprintf(cmd, sizeof(cmd), "./snapshot_report %s", path);
+        FILE *report = popen(cmd, "r");
+        bool named = false, regions = false;
+        while (report && fgets(line, sizeof(line), report)) {
+            named = named || strncmp(line, "family check_snapshot", 21) == 0;
+            regions = regions || strstr(line, "large regions") != NULL;
+        }
+        CHECK(report && pclose(report) == 0 && named && regions);
+    }
+    unlink(path);
+
+    xfree(a);
+    xfree(c);
+    xfree(big);
+}
+
+/* page size: a size is accepted until the first family is registered and
+ * rejected after that; runs in a child before anything is registered */
+static void check_page_size(void) {
+    size_t os_page = (size_t)getpagesize();
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        failures = 0;
+        CHECK(mm_init_with_page_size(os_page / 2, MM_BACKING_DEFAULT) == -1);
+        CHECK(mm_init_with_page_size(3 * os_page, MM_BACKING_DEFAULT) == -1);
+        CHECK(mm_init_with_page_size((size_t)MM_MAX_VM_PAGE_SIZE * 2, MM_BACKING_DEFAULT) == -1);
+        CHECK(mm_init_with_page_size(4 * os_page, MM_BACKING_DEFAULT) == 0);
+        mm_init(); /* keeps the size */
+        CHECK(SYSTEM_PAGE_SIZE == 4 * os_page);
+
+        mm_family_handle_t family = mm_instantiate_new_page_family("check_page_size", 64);
+        char *p = xcalloc_h(family, 2 * os_page);
+        void *page_hdr = MM_GET_PAGE_HDR_FROM_PTR(p);
+        CHECK(MM_PAGE_KIND(page_hdr) == MM_PAGE_BLOCKS && (uintptr_t)page_hdr % (4 * os_page) == 0);
+        xfree(p);
+        CHECK(mm_init_with_page_size(8 * os_page, MM_BACKING_DEFAULT) == -1);
+        CHECK(mm_init_with_page_size(4 * os_page, MM_BACKING_DEFAULT) == 0);
+        fflush(stdout);
+        _exit(failures ? 1 : 0);
+    }
+    int status = 0;
+    CHECK(pid > 0 && waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/* NUMA pools: an allocation is local when the page that served it is on
+ * the caller's node, a free when the caller is on the pool's node. Built
+ * with -DMM_NUMA_FAKE_NODES (make test-numa) the thread walks the fake
+ * nodes, one past the last included, whose allocations fold onto node 0 */
+static int32_t numa_page_node(void *ptr) {
+    void *page_hdr = MM_GET_PAGE_HDR_FROM_PTR(ptr);
+    if (MM_PAGE_KIND(page_hdr) == MM_PAGE_LARGE)
+        return ((mm_large_region_t *)page_hdr)->numa_node;
+    return ((vm_page_t *)page_hdr)->numa_node;
+}
+
+static void check_numa(void) {
+    MM_REG_STRUCT(check_numa, 64);
+    CHECK(mm_set_page_family_numa("check_numa") == 0);
+    CHECK(mm_set_page_family_numa("check_numa") == -1);
+    mm_family_handle_t family = lookup_page_family_by_name("check_numa");
+    uint32_t nodes = family->numa_nodes;
+    CHECK(nodes >= 1 && nodes <= MM_NUMA_MAX_NODES);
+
+#ifdef MM_NUMA_FAKE_NODES
+    CHECK(nodes == MM_NUMA_FAKE_NODES);
+    uint32_t callers = nodes + 1;
+#else
+    uint32_t callers = 1;
+#endif
+    void *ptrs[(MM_NUMA_MAX_NODES + 1) * 4];
+    uint32_t n = 0;
+    uint64_t local = 0, remote = 0, remote_frees = 0;
+    for (uint32_t node = 0; node < callers; node++) {
+#ifdef MM_NUMA_FAKE_NODES
+        mm_numa_fake_set_node(node);
+#endif
+        void *batch[2];
+        ptrs[n] = xcalloc_h(family, 100);
+        ptrs[n + 1] = xcalloc_h(family, 3 * SYSTEM_PAGE_SIZE);
+        CHECK(xcalloc_bulk(family, 200, 2, batch) == 2);
+        ptrs[n + 2] = batch[0];
+        ptrs[n + 3] = batch[1];
+        for (uint32_t i = n; i < n + 4; i++) {
+            if (numa_page_node(ptrs[i]) == (int32_t)node)
+                local++;
+            else
+                remote++;
+            /* freed below from node 0 */
+            remote_frees += mm_family_of(ptrs[i])->numa_node != 0;
+        }
+        n += 4;
+    }
+#ifdef MM_NUMA_FAKE_NODES
+    mm_numa_fake_set_node(0);
+    CHECK(remote >= 4); /* the folded node owns no page */
+#endif
+
+    mm_stats_t s;
+    CHECK(mm_get_stats(family, &s) == 0);
+    CHECK(s.allocs == n && s.numa_local_allocs + s.numa_remote_allocs == n);
+#ifdef MM_NUMA_FAKE_NODES
+    CHECK(s.numa_local_allocs == local && s.numa_remote_allocs == remote);
+#else
+    (void)local;
+    (void)remote;
+    (void)remote_frees;
+#endif
+    xfree(ptrs[0]);
+    xfree(ptrs[1]);
+    xfree_bulk(ptrs + 2, n - 2);
+    CHECK(mm_get_stats(family, &s) == 0);
+    CHECK(s.frees == n && s.bytes_in_use == 0);
+#ifdef MM_NUMA_FAKE_NODES
+    CHECK(s.numa_remote_frees == remote_frees);
+#endif
+}
+
+/* arenas: zeroed bump allocation, reset recycles single pages and
+ * rezeroes them, oversized chunks and destroy go back to the kernel */
+static void check_arena(void) {
+    mm_arena_t *arena = mm_arena_create();
+    CHECK(arena && arena->pages == 1);
+    unsigned char *first = mm_arena_alloc(arena, 100);
+    unsigned char *second = mm_arena_alloc(arena, 100);
+    unsigned char *aligned = mm_arena_alloc_aligned(arena, 32, 64);
+    CHECK(first && second == first + 104 && aligned && (uintptr_t)aligned % 64 == 0);
+    CHECK(mm_arena_alloc_aligned(arena, 32, 24) == NULL);
+    CHECK(MM_PAGE_KIND(MM_GET_PAGE_HDR_FROM_PTR(first)) == MM_PAGE_ARENA);
+    memset(first, 0x5a, 100);
+    errors_begin();
+    xfree(first);
+    CHECK(errors_end() == 1);
+
+    /* spill over a second page, then one object no page could hold */
+    bool ok = true;
+    for (int i = 0; i < 64; i++) {
+        unsigned char *p = mm_arena_alloc(arena, 128);
+        ok = ok && p && p[0] == 0 && p[127] == 0;
+        if (p)
+            memset(p, 0xa5, 128);
+    }
+    CHECK(ok);
+    uint32_t single_pages = arena->pages;
+    CHECK(single_pages >= 2);
+    unsigned char *big = mm_arena_alloc(arena, 2 * SYSTEM_PAGE_SIZE);
+    CHECK(big && big[0] == 0 && big[2 * SYSTEM_PAGE_SIZE - 1] == 0);
+    CHECK(arena->pages >= single_pages + 3);
+
+    mm_arena_reset(arena);
+    CHECK(arena->pages == single_pages && arena->bytes_allocated == 0);
+    unsigned char *again = mm_arena_alloc(arena, 100);
+    CHECK(again == first && again[0] == 0 && again[99] == 0);
+    ok = true;
+    for (int i = 0; i < 64; i++) {
+        unsigned char *p = mm_arena_alloc(arena, 128);
+        ok = ok && p && p[0] == 0 && p[127] == 0;
+    }
+    CHECK(ok && arena->pages == single_pages);
+
+    mm_stats_t before, after;
+    mm_get_global_stats(&before);
+    mm_arena_destroy(arena);
+    mm_get_global_stats(&after);
+    CHECK(after.pages_unmapped - before.pages_unmapped == single_pages);
+}
+
+/* xrealloc: grows into a free neighbour, shrinks in place, moves when
+ * boxed in, and counts only real size changes */
+static void check_realloc(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_realloc", 64);
+    mm_stats_t before, after;
+    mm_get_stats(family, &before);
+
+    char *a = xmalloc_h(family, 100);
+    memset(a, 'a', 100);
+    char *grown = xrealloc(a, 300);
+    CHECK(grown == a && mm_usable_size(a) >= 300);
+    char *shrunk = xrealloc(a, 50);
+    CHECK(shrunk == a && mm_usable_size(a) < 300);
+    CHECK(xrealloc(a, 50) == a);
+    mm_get_stats(family, &after);
+    CHECK(after.realloc_grows_in_place == before.realloc_grows_in_place + 1);
+    CHECK(after.realloc_shrinks_in_place == before.realloc_shrinks_in_place + 1);
+    CHECK(after.reallocs == before.reallocs + 3);
+
+    char *b = xmalloc_h(family, 64); /* boxes a in */
+    CHECK((block_meta_data_t *)b - 1 == NEXT_META_BLOCK((block_meta_data_t *)a - 1));
+    char *moved = xrealloc(a, 1000);
+    CHECK(moved && moved != a);
+    bool kept = true;
+    for (int i = 0; i < 50; i++)
+        kept = kept && moved[i] == 'a';
+    CHECK(kept);
+    CHECK(MM_BLOCK_IS_FREE((block_meta_data_t *)a - 1));
+
+    /* to and from a large region */
+    char *big = xrealloc(moved, 3 * SYSTEM_PAGE_SIZE);
+    CHECK(big && MM_PAGE_KIND(MM_GET_PAGE_HDR_FROM_PTR(big)) == MM_PAGE_LARGE && big[49] == 'a');
+    char *small = xrealloc(big, 200);
+    CHECK(small && MM_PAGE_KIND(MM_GET_PAGE_HDR_FROM_PTR(small)) == MM_PAGE_BLOCKS && small[0] == 'a');
+
+    CHECK(xrealloc(NULL, 10) == NULL); /* documented error, no family to use */
+    CHECK(xrealloc(small, 0) == NULL);
+    xfree(b);
+    mm_get_stats(family, &after);
+    CHECK(after.bytes_in_use == 0);
+    CHECK(family->first_page == NULL && family->large_regions == NULL);
+}
+
+/* page map and validated xfree: foreign, interior and misaligned pointers
+ * are reported without touching the heap */
+static uint64_t family_frees(mm_family_handle_t family) {
+    mm_stats_t stats;
+    mm_get_stats(family, &stats);
+    return stats.frees;
+}
+
+static void check_validated_free(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_validate", 64);
+    mm_family_handle_t slab_family = mm_instantiate_new_slab_family("check_validate_slab", 32);
+    int on_stack = 0;
+    char *p = xcalloc_h(family, 64);
+    char *s = xcalloc_h(slab_family, 32);
+
+    CHECK(mm_owns(p) && mm_owns(p + 63) && mm_owns(s));
+    CHECK(!mm_owns(&on_stack) && !mm_owns(NULL));
+    CHECK(mm_page_map_lookup(p) == MM_GET_PAGE_HDR_FROM_PTR(p));
+    CHECK(mm_family_of(p) == family && mm_family_of(s) == slab_family);
+
+    uint64_t frees = family_frees(family) + family_frees(slab_family);
+    errors_begin();
+    xfree(&on_stack);
+    xfree(p + 8);
+    xfree(s + 4);
+    CHECK(errors_end() == 3);
+    CHECK(family_frees(family) + family_frees(slab_family) == frees);
+
+    mm_arena_t *arena = mm_arena_create();
+    void *in_arena = mm_arena_alloc(arena, 64);
+    errors_begin();
+    xfree(in_arena);
+    CHECK(errors_end() == 1);
+    mm_arena_destroy(arena);
+
+    xfree(p);
+    xfree(s);
+    /* once its page is released the map forgets it */
+    CHECK(!mm_owns(p));
+}
+
+/* remote frees: a free that finds the lock busy is queued, and the next
+ * lock holder drains it, whichever path that holder takes; so do thread
+ * cache flushes and switching the queue off */
+#define CHECK_REMOTE_THREADS 4
+#define CHECK_REMOTE_OBJECTS 20000
+
+static mm_family_handle_t remote_family;
+
+static void *remote_freer(void *arg) {
+    void **objs = arg;
+    for (int i = 0; i < CHECK_REMOTE_OBJECTS; i++) {
+        xfree(objs[i]);
+        objs[i] = xmalloc_h(remote_family, 16 + i % 200);
+    }
+    for (int i = 0; i < CHECK_REMOTE_OBJECTS; i++)
+        xfree(objs[i]);
+    return NULL;
+}
+
+/* free ptr while holding its family's lock, so the free must queue */
+static void remote_free_queued(mm_family_handle_t family, void *ptr) {
+    pthread_mutex_lock(&family->lock);
+    xfree(ptr);
+    pthread_mutex_unlock(&family->lock);
+}
+
+static void check_remote_free(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_remote", 64);
+    mm_set_remote_free(true);
+    mm_stats_t before, after;
+    mm_get_stats(family, &before);
+
+    void *a = xmalloc_h(family, 64), *b = xmalloc_h(family, 64), *c = xmalloc_h(family, 64);
+    remote_free_queued(family, a);
+    remote_free_queued(family, b);
+    CHECK(family->remote_frees != NULL);
+    mm_get_stats(family, &after);
+    CHECK(after.remote_frees == before.remote_frees + 2);
+    CHECK(family->remote_frees == NULL); /* mm_get_stats drained them */
+    CHECK(after.bytes_in_use == before.bytes_in_use + mm_usable_size(c));
+
+    /* a bulk free drains as well */
+    void *d = xmalloc_h(family, 64);
+    remote_free_queued(family, c);
+    CHECK(family->remote_frees != NULL);
+    xfree_bulk(&d, 1);
+    CHECK(family->remote_frees == NULL);
+
+    /* so does flushing a thread cache that holds the family */
+    void *e = xmalloc_h(family, 64), *f = xmalloc_h(family, 64);
+    remote_free_queued(family, e);
+    mm_set_thread_cache(true);
+    xfree(f);
+    CHECK(xmalloc_h(family, 64) == f); /* the bin is empty but still names the family */
+    mm_thread_cache_flush();
+    CHECK(family->remote_frees == NULL);
+    mm_set_thread_cache(false);
+
+    /* and switching the queue off */
+    remote_free_queued(family, f);
+    mm_set_remote_free(false);
+    CHECK(family->remote_frees == NULL);
+    mm_set_remote_free(true);
+
+    /* threads freeing into one family end with nothing in use */
+    remote_family = family;
+    static void *objs[CHECK_REMOTE_THREADS][CHECK_REMOTE_OBJECTS];
+    for (int t = 0; t < CHECK_REMOTE_THREADS; t++)
+        for (int i = 0; i < CHECK_REMOTE_OBJECTS; i++)
+            objs[t][i] = xmalloc_h(family, 16 + i % 200);
+    pthread_t threads[CHECK_REMOTE_THREADS];
+    for (int t = 0; t < CHECK_REMOTE_THREADS; t++)
+        pthread_create(&threads[t], NULL, remote_freer, objs[t]);
+    for (int t = 0; t < CHECK_REMOTE_THREADS; t++)
+        pthread_join(threads[t], NULL);
+    mm_get_stats(family, &after);
+    CHECK(after.allocs == after.frees);
+    CHECK(after.bytes_in_use == 0);
+    mm_set_remote_free(false);
+}
+
+/* MM_POLICY_DENSE: a request is served from the fullest page that fits it */
+static void check_dense(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_dense", 64);
+    CHECK(mm_set_page_family_policy("check_dense", MM_POLICY_DENSE) == 0);
+    enum { N = 200, SIZE = 200 };
+    char *objs[N];
+    for (int i = 0; i < N; i++)
+        objs[i] = xmalloc_h(family, SIZE);
+
+    /* page A keeps one block, page B loses one */
+    void *page_a = MM_GET_PAGE_HDR_FROM_PTR(objs[0]);
+    void *page_b = MM_GET_PAGE_HDR_FROM_PTR(objs[N / 2]);
+    CHECK(page_a != page_b);
+    void *kept = NULL;
+    for (int i = 0; i < N; i++) {
+        if (MM_GET_PAGE_HDR_FROM_PTR(objs[i]) != page_a)
+            continue;
+        if (kept) {
+            xfree(objs[i]);
+            objs[i] = NULL;
+        } else {
+            kept = objs[i];
+        }
+    }
+    xfree(objs[N / 2]);
+    objs[N / 2] = NULL;
+
+    char *next = xmalloc_h(family, SIZE);
+    CHECK(MM_GET_PAGE_HDR_FROM_PTR(next) == page_b);
+    xfree(next);
+    for (int i = 0; i < N; i++)
+        xfree(objs[i]);
+    mm_stats_t stats;
+    mm_get_stats(family, &stats);
+    CHECK(stats.bytes_in_use == 0);
+}
+
+/* Sum of the estimated bytes on folded-stack lines of one family */
+static uint64_t profile_folded_bytes(const char *family_name, bool *pprof_ok) {
+    FILE *out = tmpfile();
+    CHECK(mm_profile_dump_fd(fileno(out), MM_PROFILE_FOLDED) == 0);
+    rewind(out);
+    char line[4096];
+    uint64_t total = 0;
+    size_t len = strlen(family_name);
+    while (fgets(line, sizeof(line), out)) {
+        char *weight = strrchr(line, ' ');
+        if (strncmp(line, family_name, len) == 0 && line[len] == ';' && weight)
+            total += strtoull(weight + 1, NULL, 10);
+    }
+    fclose(out);
+
+    out = tmpfile();
+    CHECK(mm_profile_dump_fd(fileno(out), MM_PROFILE_PPROF) == 0);
+    rewind(out);
+    bool header = fgets(line, sizeof(line), out) && strncmp(line, "heap profile: ", 14) == 0;
+    bool maps = false;
+    while (fgets(line, sizeof(line), out))
+        maps = maps || strncmp(line, "MAPPED_LIBRARIES:", 17) == 0;
+    fclose(out);
+    *pprof_ok = header && maps;
+    return total;
+}
+
+/* profiler: with a one-byte interval every allocation is sampled, and
+ * freed objects leave the profile */
+static void check_profile(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_profile", 64);
+    enum { N = 100, SIZE = 1000 };
+    void *objs[N];
+    CHECK(mm_profile_start(1) == 0);
+    for (int i = 0; i < N; i++)
+        objs[i] = xmalloc_h(family, SIZE);
+    bool pprof_ok = false;
+    uint64_t live = profile_folded_bytes("check_profile", &pprof_ok);
+    CHECK(pprof_ok);
+    /* the countdown left by an earlier profile may skip the first few */
+    CHECK(live >= (uint64_t)(N - 5) * SIZE && live <= (uint64_t)N * SIZE);
+
+    for (int i = 0; i < N; i += 2)
+        xfree(objs[i]);
+    uint64_t half = profile_folded_bytes("check_profile", &pprof_ok);
+    CHECK(half <= live - (uint64_t)(N / 2 - 5) * SIZE && half >= live - (uint64_t)(N / 2) * SIZE);
+    mm_profile_stop();
+    CHECK(profile_folded_bytes("check_profile", &pprof_ok) == 0);
+
+    for (int i = 1; i < N; i += 2)
+        xfree(objs[i]);
+}
+
+/* frees made by TLS destructors after the thread cache flushed itself
+ * must reach the family rather than a dead cache */
+static pthread_key_t late_free_key;
+
+static void late_free(void *ptr) {
+    xfree(ptr);
+}
+
+static void *late_free_thread(void *arg) {
+    void *cached = xmalloc_h(arg, 64);
+    xfree(cached); /* registers the cache's exit destructor first */
+    pthread_setspecific(late_free_key, xmalloc_h(arg, 64));
+    return NULL;
+}
+
+static void check_late_free(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_late_free", 64);
+    mm_set_thread_cache(true); /* creates the cache's key before ours */
+    pthread_key_create(&late_free_key, late_free);
+    pthread_t thread;
+    pthread_create(&thread, NULL, late_free_thread, family);
+    pthread_join(thread, NULL);
+    mm_set_thread_cache(false);
+    mm_stats_t stats;
+    mm_get_stats(family, &stats);
+    CHECK(stats.bytes_in_use == 0);
+    pthread_key_delete(late_free_key);
+}
+
+/* alignments of a page or more, or too large to pad within a page, come
+ * from large regions that free cleanly */
+static void check_big_alignment(void) {
+    mm_family_handle_t family = mm_instantiate_new_page_family("check_big_align", 64);
+    uint32_t alignments[] = { 64, 4096, 8192, 65536 };
+    uint32_t sizes[] = { 100, (uint32_t)MM_MAX_PAGE_ALLOCATABLE_MEMORY - 64, 3 * (uint32_t)SYSTEM_PAGE_SIZE };
+    errors_begin();
+    for (size_t a = 0; a < sizeof(alignments) / sizeof(alignments[0]); a++) {
+        for (size_t z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++) {
+            char *p = xcalloc_aligned(family, sizes[z], alignments[a]);
+            CHECK(p && (uintptr_t)p % alignments[a] == 0);
+            if (!p)
+                continue;
+            CHECK(mm_family_of(p) == family && mm_usable_size(p) >= sizes[z]);
+            CHECK(p[0] == 0 && p[sizes[z] - 1] == 0);
+            memset(p, 0xee, sizes[z]);
+            xfree(p);
+        }
+    }
+    CHECK(errors_end() == 0);
+    mm_stats_t stats;
+    mm_get_stats(family, &stats);
+    CHECK(stats.bytes_in_use == 0);
+}
+
+/* out-of-memory reports go to stdout unless mm_set_quiet is on; a child
+ * under a small address-space limit fails one large request each way */
+static void check_quiet(void) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        mm_family_handle_t family = mm_instantiate_new_page_family("check_quiet", 64);
+        FILE *out = tmpfile();
+        if (!out)
+            _exit(2);
+        setvbuf(stdout, NULL, _IONBF, 0);
+        dup2(fileno(out), STDOUT_FILENO);
+        struct rlimit limit = { 1u << 30, 1u << 30 };
+        setrlimit(RLIMIT_AS, &limit);
+        int nulls = !xmalloc_h(family, 3u << 30);
+        mm_set_quiet(true);
+        nulls += !xmalloc_h(family, 3u << 30);
+        nulls += !xrealloc(xmalloc_h(family, 64), 3u << 30);
+        uint32_t done = xcalloc_bulk(family, 3u << 30, 1, &(void *){NULL});
+        mm_set_quiet(false);
+
+        char line[128];
+        int reports = 0;
+        rewind(out);
+        while (fgets(line, sizeof(line), out))
+            reports += strstr(line, "Not enough memory in page family 'check_quiet'") != NULL;
+        _exit(nulls == 3 && done == 0 && reports == 1 ? 0 : 1);
+    }
+    int status = 0;
+    CHECK(pid > 0 && waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
 
 int main() {
     printf("=== Custom Heap Manager Test ===\n");
 
+    check_page_size();
     mm_init();
 
     // Register page families
@@ -63,8 +1161,36 @@ int main() {
     void *p5 = xcalloc("another_struct", 100);
     printf("\n=== After allocating p5 (another_struct, 100 bytes) ===\n");
     dump_lmm_state();
+    xfree(p5);
+
+    printf("\n=== Feature checks ===\n");
+    check_refill();
+    check_heap_index();
+    check_size_classes();
+    check_slab();
+    check_thread_cache();
+    check_family_hash();
+    check_large();
+    check_page_cache();
+    check_zeroing();
+    check_bulk();
+    check_page_counters();
+    check_blocks();
+    check_alignment();
+    check_stats();
+    check_snapshot();
+    check_numa();
+    check_arena();
+    check_realloc();
+    check_validated_free();
+    check_remote_free();
+    check_dense();
+    check_profile();
+    check_late_free();
+    check_big_alignment();
+    check_quiet();
 
-    printf("\n=== TEST COMPLETE ===\n");
-    return 0;
+    printf("\n=== TEST COMPLETE: %d failure(s) ===\n", failures);
+    return failures ? 1 : 0;
 }
 
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <pthread.h>
+
+/* Checks for libmm_preload.so; `make test` runs this binary under
+ * LD_PRELOAD with the default and with 4 KiB allocator pages. It only uses
+ * the malloc API, so it also runs (less strictly) against glibc.
+ * Covered: size classes and usable sizes, calloc zeroing, realloc keeping
+ * data, every aligned entry point around the page size, requests above
+ * the last size class, and threads freeing each other's blocks. No free
+ * may print an "xfree:" diagnostic. */
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static bool under_shim(void) {
+    void *p = malloc(20);
+    bool shim = malloc_usable_size(p) == 32; /* 16-byte classes; glibc gives 24 */
+    free(p);
+    return shim;
+}
+
+static bool filled(const unsigned char *p, size_t n, unsigned char byte) {
+    for (size_t i = 0; i < n; i++)
+        if (p[i] != byte)
+            return false;
+    return true;
+}
+
+static void check_sizes(void) {
+    for (size_t n = 0; n < 70000; n = n < 600 ? n + 1 : n * 5 / 4) {
+        unsigned char *p = malloc(n);
+        CHECK(p && (uintptr_t)p % 16 == 0 && malloc_usable_size(p) >= n);
+        if (p)
+            memset(p, 0x5a, n);
+        unsigned char *z = calloc(1, n);
+        CHECK(z && filled(z, n, 0));
+        free(p);
+        free(z);
+    }
+    volatile size_t too_many = SIZE_MAX / 2; /* hides the overflow from the compiler */
+    CHECK(calloc(too_many, 4) == NULL);
+}
+
+static void check_realloc(void) {
+    unsigned char *p = malloc(10);
+    memset(p, 1, 10);
+    size_t size = 10;
+    for (size_t next = 40; next < 300000; next = next * 3 / 2) {
+        p = realloc(p, next);
+        CHECK(p && filled(p, size, 1));
+        if (!p)
+            return;
+        memset(p, 1, next);
+        size = next;
+    }
+    p = realloc(p, 5);
+    CHECK(p && filled(p, 5, 1));
+    CHECK(realloc(p, 0) == NULL);
+}
+
+static void check_aligned(size_t page) {
+    for (size_t n = page - 300; n < page + 100; n += 7) {
+        for (size_t a = 32; a <= 16384; a *= 2) {
+            void *q = NULL;
+            CHECK(posix_memalign(&q, a, n) == 0 && (uintptr_t)q % a == 0);
+            CHECK(malloc_usable_size(q) >= n);
+            if (q)
+                memset(q, 0x77, n);
+            free(q);
+        }
+    }
+    void *p = aligned_alloc(64, 1000);
+    void *m = memalign(4096, 100);
+    void *v = valloc(100);
+    void *pv = pvalloc(100);
+    long os_page = sysconf(_SC_PAGESIZE);
+    CHECK(p && (uintptr_t)p % 64 == 0);
+    CHECK(m && (uintptr_t)m % 4096 == 0);
+    CHECK(v && (uintptr_t)v % os_page == 0);
+    CHECK(pv && (uintptr_t)pv % os_page == 0 && malloc_usable_size(pv) >= (size_t)os_page);
+    free(p);
+    free(m);
+    free(v);
+    free(pv);
+    void *bad = NULL;
+    CHECK(posix_memalign(&bad, 24, 100) != 0);
+}
+
+/* beyond the last size class; mapped but never touched */
+static void check_huge(void) {
+    size_t sizes[] = { (1ul << 31) - 4096, (1ul << 31) + 1, (3ul << 30) };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        char *p = malloc(sizes[i]);
+        CHECK(p && malloc_usable_size(p) >= sizes[i]);
+        if (p)
+            p[sizes[i] - 1] = 1;
+        free(p);
+    }
+}
+
+/* each thread churns its own blocks and frees what its neighbour made */
+#define THREADS 4
+#define RING 1024
+
+static void *rings[THREADS][RING];
+
+static void *worker(void *arg) {
+    long id = (long)arg;
+    uint32_t seed = (uint32_t)id * 7 + 1;
+    void *mine[256] = { 0 };
+    size_t sizes[256];
+    for (int i = 0; i < 200000; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        int j = (seed >> 8) % 256;
+        if (mine[j]) {
+            if (!filled(mine[j], sizes[j] < 64 ? sizes[j] : 64, (unsigned char)j))
+                __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+            free(mine[j]);
+            mine[j] = NULL;
+        } else {
+            sizes[j] = 1 + (seed >> 4) % ((seed >> 30) ? 500 : 40000);
+            mine[j] = (seed >> 24) % 4 ? malloc(sizes[j]) : calloc(1, sizes[j]);
+            memset(mine[j], j, sizes[j]);
+        }
+        /* hand a block to the next thread through an exchange */
+        void *given = malloc(100);
+        void *taken = __atomic_exchange_n(&rings[(id + 1) % THREADS][i % RING], given, __ATOMIC_ACQ_REL);
+        free(taken);
+    }
+    for (int j = 0; j < 256; j++)
+        free(mine[j]);
+    return NULL;
+}
+
+static void check_threads(void) {
+    pthread_t threads[THREADS];
+    for (long t = 0; t < THREADS; t++)
+        pthread_create(&threads[t], NULL, worker, (void *)t);
+    for (int t = 0; t < THREADS; t++)
+        pthread_join(threads[t], NULL);
+    for (int t = 0; t < THREADS; t++)
+        for (int r = 0; r < RING; r++)
+            free(rings[t][r]);
+}
+
+int main(void) {
+    bool shim = under_shim();
+    printf("=== malloc checks (%s) ===\n", shim ? "libmm_preload" : "not preloaded");
+    CHECK(shim || !getenv("LD_PRELOAD"));
+
+    /* capture stderr: frees must stay silent */
+    fflush(stderr);
+    FILE *errors = tmpfile();
+    int saved = dup(STDERR_FILENO);
+    dup2(fileno(errors), STDERR_FILENO);
+
+    check_sizes();
+    check_realloc();
+    check_aligned(4096);
+    check_aligned(65536);
+    check_huge();
+    check_threads();
+
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    rewind(errors);
+    char line[256];
+    int diagnostics = 0;
+    while (fgets(line, sizeof(line), errors)) {
+        fputs(line, stderr);
+        diagnostics += strncmp(line, "xfree:", 6) == 0;
+    }
+    CHECK(diagnostics == 0);
+
+    printf("=== TEST COMPLETE: %d failure(s) ===\n", failures);
+    return failures ? 1 : 0;
+}